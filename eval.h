@@ -31,9 +31,42 @@ SOFTWARE.
 #include <vector>
 #include <stack>
 #include <map>
+#include <memory>
 #include <queue>
+#include <algorithm>
+#include <atomic>
 #include <exception>
+#include <stdexcept>
+#include <system_error>
+#include <cstdint>
+#include <cctype>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <locale>
 #include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <type_traits>
+
+#if !defined(EVAL_NO_POSIX) && (defined(__unix__) || defined(__APPLE__))
+#define EVAL_POSIX 1 // Shared memory, files and processes; define EVAL_NO_POSIX to leave them out.
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#endif
 
 //// Dragons:
 #pragma mark - Probably Shouldn't be Macros
@@ -44,6 +77,13 @@ SOFTWARE.
 //
 #define EVAL_MOVE_TOP_UNTIL_LEFT_PAREN(from, to) while (!from.empty() && from.top() != "(") {EVAL_MOVE_TOP(from, to);}
 
+#pragma mark - Hints
+#if defined(__GNUC__) || defined(__clang__)
+#define EVAL_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define EVAL_PREFETCH(addr)
+#endif
+
 #pragma mark - Errors
 #define EVAL_UNREC_TOKEN(token) std::invalid_argument("Unrecognized token type for symbol: \"" + token + "\"!")
 #define EVAL_UNDEFINED_VAR(token) std::invalid_argument("Undefined variable: \"" + token + "\"!")
@@ -56,6 +96,52 @@ SOFTWARE.
 #define EVAL_INVALID_FN_NUMBER_ARGS(fn, expected, received) \
 std::domain_error("Function "#fn" has wrong number of arguments! Expected " + std::to_string(expected) + " but got " + std::to_string(received) + ".")
 #define EVAL_INVALID_ARG_TYPE(arg) std::invalid_argument("Function arg " + arg + " is wrong type!")
+#define EVAL_INVALID_NATIVE_NUMBER_ARGS(name, expected, received) \
+std::domain_error("Function " + name + " has wrong number of arguments! Expected " + std::to_string(expected) + " but got " + std::to_string(received) + ".")
+// Compilation
+#define EVAL_NOT_REALTIME_SAFE(name) std::invalid_argument("Function \"" + name + "\" is not real-time safe!")
+#define EVAL_TOO_DEEP std::length_error("Expression is nested too deeply!")
+#define EVAL_TOO_MANY_SLOTS std::length_error("Expression references too many variables!")
+#define EVAL_INVALID_DEFINITION(def) std::invalid_argument("Invalid function definition: \"" + def + "\"!")
+#define EVAL_NOT_PURE(name) std::invalid_argument("Function \"" + name + "\" may not be pure; its results can't be memoized!")
+#define EVAL_NOT_SERIALIZABLE std::invalid_argument("Programs calling user functions or with several outputs can't be serialized!")
+#define EVAL_INVALID_STATEMENT(statement) std::invalid_argument("Invalid statement: \"" + statement + "\"!")
+#define EVAL_INVALID_IMAGE std::invalid_argument("Invalid program image!")
+#define EVAL_INVALID_COLUMN_FILE(path) std::invalid_argument("Invalid column file: \"" + path + "\"!")
+#define EVAL_INVALID_LAYOUT(what) std::invalid_argument("Invalid record layout: " + std::string(what) + "!")
+#define EVAL_UNDEFINED_FIELD(name) std::invalid_argument("Undefined record field: \"" + name + "\"!")
+#define EVAL_INVALID_EDIT std::out_of_range("Edit is outside the text!")
+#define EVAL_CACHE_MISMATCH(name) std::invalid_argument("Shared cache \"" + name + "\" was created with different sizes!")
+#define EVAL_CACHE_TIMEOUT(name) std::runtime_error("Shared cache \"" + name + "\" was never initialized!")
+#define EVAL_SHARD_FAILED(shard) std::runtime_error("Shard " + std::to_string(shard) + " failed!")
+#define EVAL_SYSTEM_ERROR(what) std::system_error(errno, std::generic_category(), what)
+#pragma mark
+
+#pragma mark - Limits
+// Size of the fixed value stack compiled programs run on; deeper expressions are rejected at compile time.
+#ifndef EVAL_MAX_DEPTH
+#define EVAL_MAX_DEPTH 64
+#endif
+// Fewest rows worth a task or a file read of their own; blocks that run in cache are sized by `blockRows()`.
+#ifndef EVAL_BATCH_BLOCK
+#define EVAL_BATCH_BLOCK 256
+#endif
+// Bytes of a block's registers (stack levels and temporaries) `runBatch()` keeps in cache; see `tuneBlocks()`.
+#ifndef EVAL_BLOCK_BUDGET
+#define EVAL_BLOCK_BUDGET (32 << 10)
+#endif
+// Buffers the engine allocates for itself at least this big ask for 2 MB pages; 0 turns that off.
+#ifndef EVAL_HUGE_PAGE_MIN
+#define EVAL_HUGE_PAGE_MIN (8 << 20)
+#endif
+// Milliseconds opening a `SharedCache` waits for the process creating it to set it up.
+#ifndef EVAL_CACHE_WAIT_MS
+#define EVAL_CACHE_WAIT_MS 1000
+#endif
+// Number of variable slots a `RealtimeChannel` keeps for its programs.
+#ifndef EVAL_MAX_SLOTS
+#define EVAL_MAX_SLOTS 64
+#endif
 #pragma mark
 
 #pragma mark - Function Bindings
@@ -63,6 +149,14 @@ std::domain_error("Function "#fn" has wrong number of arguments! Expected " + st
 #define EVAL_ARG_NUMBER(idx) Type::toNumber(args[idx]) // Cast value at index to number
 #define EVAL_BIND_INCL_FN(name) fns[#name] = std::bind(&_eval::Builtins:: name , std::placeholders::_1); // Bind an included function
 #define EVAL_DEF_INCL_FN(name) inline Number name(FnArgs args) {EVAL_FN_IMPL_NUMBER(#name, std:: name);} // Define an included function
+#define EVAL_DEF_NATIVE_FN(name) inline Number name(const Number *args) {return std:: name(args[0]);} // Define a native function
+#define EVAL_NATIVE(name, arity) {#name, arity, &_eval::Natives:: name} // Native table entry
+#define EVAL_DEF_DSL_FN(name) template <typename A, typename = typename std::enable_if<IsExpr<A>::value>::type> \
+inline Native1<&Natives:: name, A> name(const A &a) {return Native1<&Natives:: name, A>(a);} // Define a DSL function
+#define EVAL_DEF_DSL_OP(symbol, op) template <typename L, typename R, typename = typename std::enable_if<AreOperands<L, R>::value>::type> \
+inline Binary<Opcode:: op, typename Of<L>::type, typename Of<R>::type> operator symbol(const L &l, const R &r) { \
+  return Binary<Opcode:: op, typename Of<L>::type, typename Of<R>::type>(wrap(l), wrap(r)); \
+} // Define a DSL operator
 #define EVAL_FN_IMPL_NUMBER(name, fn) \
 if (args.empty()) {throw EVAL_INVALID_FN_NUMBER_ARGS(name, 1, 0);} \
 else if (args.size() > 1) {throw EVAL_INVALID_FN_NUMBER_ARGS(name, 1, args.size());} \
@@ -111,10 +205,270 @@ namespace jgod { namespace _eval { // Make it clear that this is an implementati
   typedef std::function<Number(FnArgs)> Fn; // Functions only have one return type, for now.
   typedef std::map<std::string, Fn> FnMap;
 
+#pragma mark - Number Parsing
+  namespace Parse {
+    // Whether 8 bytes (loaded little-endian) are all ASCII digits; checks a whole word at once.
+    inline bool isEightDigits(const uint64_t v) {
+      return ((v & 0xF0F0F0F0F0F0F0F0ull) | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+    }
+    // Value of 8 ASCII digits (loaded little-endian), combining pairs, then quads, then halves.
+    inline uint64_t eightDigits(uint64_t v) {
+      const uint64_t mask = 0x000000FF000000FFull, mul1 = 100 + (1000000ull << 32), mul2 = 1 + (10000ull << 32);
+      v -= 0x3030303030303030ull;
+      v = v*10 + (v >> 8);
+      return ((v & mask)*mul1 + ((v >> 16) & mask)*mul2) >> 32;
+    }
+    inline bool littleEndian() {const uint16_t one = 1; unsigned char first; std::memcpy(&first, &one, 1); return first == 1;}
+
+    // Accumulates up to 19 digits into m (the most a uint64_t holds), counting all of them.
+    inline const char *digits(const char *c, const char *end, uint64_t &m, int &count) {
+      if (littleEndian()) for (uint64_t v; end - c >= 8 && count <= 11; c += 8, count += 8) {
+        std::memcpy(&v, c, 8);
+        if (!isEightDigits(v)) break;
+        m = m*100000000 + eightDigits(v);
+      }
+      for (; c < end && *c >= '0' && *c <= '9'; ++c, ++count) if (count < 19) m = m*10 + static_cast<uint64_t>(*c - '0');
+      return c;
+    }
+
+    /**
+     Parses a decimal number, [+-]digits[.digits][(e|E)[+-]digits], when that can be done exactly with one
+     floating point operation (Clinger's fast path): up to 2^53 significant and |exponent| <= 22.
+
+     @param[in] begin
+     @param[in] end
+     @param[out] out
+     @returns end of the number, or nullptr if there isn't one or it needs `number()`
+     */
+    inline const char *fast(const char *begin, const char *end, Number &out) {
+      static const Number POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+      auto c = begin;
+      const auto negative = c < end && *c == '-';
+      if (c < end && (*c == '-' || *c == '+')) ++c;
+      uint64_t m = 0;
+      int count = 0, exp = 0;
+      c = digits(c, end, m, count);
+      if (c < end && *c == '.') {
+        const auto fraction = c + 1;
+        c = digits(fraction, end, m, count);
+        exp -= static_cast<int>(c - fraction);
+      }
+      if (!count) return nullptr;
+      if (c < end && (*c == 'e' || *c == 'E')) {
+        auto e = c + 1;
+        const auto negativeExp = e < end && *e == '-';
+        if (e < end && (*e == '-' || *e == '+')) ++e;
+        if (e < end && *e >= '0' && *e <= '9') {
+          int n = 0;
+          for (; e < end && *e >= '0' && *e <= '9'; ++e) if (n < 100000) n = n*10 + (*e - '0');
+          exp += negativeExp ? -n : n;
+          c = e;
+        }
+      }
+      if (count > 19 || m > (1ull << 53) || exp < -22 || exp > 22) return nullptr;
+      const auto v = exp < 0 ? static_cast<Number>(m)/POW10[-exp] : static_cast<Number>(m)*POW10[exp];
+      out = negative ? -v : v;
+      return c;
+    }
+
+    /**
+     Parses a decimal number like `fast()`, falling back to the (locale-independent) standard library for
+     numbers off the fast path, so results are always correctly rounded.
+
+     @returns end of the number, or `begin` if there isn't one
+     */
+    inline const char *number(const char *begin, const char *end, Number &out) {
+      const auto c = fast(begin, end, out);
+      if (c) return c;
+      const auto IS_DIGIT = [](const char ch) {return ch >= '0' && ch <= '9';};
+      auto last = begin;
+      if (last < end && (*last == '-' || *last == '+')) ++last;
+      const auto digitsStart = last;
+      while (last < end && (IS_DIGIT(*last) || *last == '.')) ++last;
+      if (std::find_if(digitsStart, last, IS_DIGIT) == last) return begin;
+      if (last < end && (*last == 'e' || *last == 'E')) { // Only an exponent if digits follow.
+        auto e = last + 1;
+        if (e < end && (*e == '-' || *e == '+')) ++e;
+        if (e < end && IS_DIGIT(*e)) {while (e < end && IS_DIGIT(*e)) ++e; last = e;}
+      }
+      std::istringstream in(std::string(begin, last));
+      in.imbue(std::locale::classic());
+      in >> out;
+      if (in.fail()) { // Out of range (or not a number after all)
+        const auto e = std::find_if(digitsStart, last, [](const char ch) {return ch == 'e' || ch == 'E';});
+        out = (e < last && e[1] == '-') ? 0 : std::numeric_limits<Number>::infinity();
+        if (*begin == '-') out = -out;
+        return last;
+      }
+      const auto consumed = static_cast<std::streamoff>(in.tellg()); // -1 once everything was consumed
+      return consumed < 0 ? last : begin + consumed;
+    }
+
+    /**
+     Parses a separated list of numbers, e.g. a CSV column; empty or malformed fields become NaN.
+
+     @param[in] begin
+     @param[in] end
+     @param[in] separator
+     @param[out] out Values are appended
+     @returns number of fields
+     */
+    inline size_t list(const char *begin, const char *end, const char separator, std::vector<Number> &out) {
+      size_t n = 0;
+      for (auto c = begin; c <= end; ++n) {
+        const auto field = static_cast<const char*>(std::memchr(c, separator, static_cast<size_t>(end - c)));
+        const auto fieldEnd = field ? field : end;
+        while (c < fieldEnd && *c == ' ') ++c;
+        Number v;
+        auto after = number(c, fieldEnd, v);
+        while (after < fieldEnd && *after == ' ') ++after;
+        out.push_back(after == fieldEnd && after != c ? v : std::nan(""));
+        c = fieldEnd + 1;
+      }
+      return n;
+    }
+  }
+
+#pragma mark - Number Formatting
+  namespace Format {
+    const size_t SIZE = 32; // Enough for any number, plus a NUL
+
+    // Writes digits d (a decimal point `exp` digits in) in fixed or scientific notation, whichever reads better.
+    inline size_t digits(const char *d, const int n, const int exp, const bool negative, char *buf) {
+      auto c = buf;
+      if (negative) *c++ = '-';
+      if (exp > 21 || exp < -5) { // Scientific, e.g. 1.5e-20
+        *c++ = d[0];
+        if (n > 1) {*c++ = '.'; std::memcpy(c, d + 1, static_cast<size_t>(n - 1)); c += n - 1;}
+        *c++ = 'e';
+        auto e = exp - 1;
+        if (e < 0) {*c++ = '-'; e = -e;}
+        char rev[4];
+        int k = 0;
+        do {rev[k++] = static_cast<char>('0' + e % 10); e /= 10;} while (e);
+        while (k) *c++ = rev[--k];
+      } else if (exp <= 0) { // 0.00ddd
+        *c++ = '0'; *c++ = '.';
+        for (int i = exp; i < 0; ++i) *c++ = '0';
+        std::memcpy(c, d, static_cast<size_t>(n)); c += n;
+      } else { // ddd, dd.d or ddd00
+        for (int i = 0; i < std::max(n, exp); ++i) {
+          if (i == exp) *c++ = '.';
+          *c++ = i < n ? d[i] : '0';
+        }
+      }
+      *c = '\0';
+      return static_cast<size_t>(c - buf);
+    }
+
+    /**
+     Writes the shortest decimal that reads back (with `Parse::number()` or `strtod`) as exactly `v`.
+     Doesn't allocate and doesn't depend on the locale.
+
+     Numbers with a short exact form (at most 2^53 after scaling by up to 10^22, which covers most data)
+     are found directly: the smallest scale whose rounded integer divides back to `v`. Others try 15 to 17
+     significant digits (1 to 17 for subnormals, which have less precision), checking each with `strtod`
+     on integer digits and an exponent, which has no decimal point for the locale to change.
+
+     @param[in] v
+     @param[out] buf At least `SIZE` bytes
+     @returns length written, not counting the NUL
+     */
+    inline size_t number(const Number v, char *buf) {
+      static const Number POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+      if (std::isnan(v)) {std::memcpy(buf, "nan", 4); return 3;}
+      if (std::isinf(v)) {std::memcpy(buf, v < 0 ? "-inf" : "inf", v < 0 ? 5 : 4); return v < 0 ? 4 : 3;}
+      const auto negative = std::signbit(v);
+      const auto a = std::fabs(v);
+      if (a == 0) {std::memcpy(buf, negative ? "-0" : "0", negative ? 3 : 2); return negative ? 2 : 1;}
+
+      char d[24];
+      int n = 0, exp = 0;
+      const auto limit = static_cast<Number>(1ull << 53);
+      for (int k = 0; k <= 22 && !n; ++k) {
+        const auto scaled = a*POW10[k];
+        if (scaled >= limit) break;
+        const auto m = static_cast<uint64_t>(std::llround(scaled));
+        if (static_cast<Number>(m)/POW10[k] != a) continue; // Exact, since m <= 2^53 and k <= 22.
+        char rev[24];
+        int len = 0;
+        for (auto r = m; r; r /= 10) rev[len++] = static_cast<char>('0' + r % 10);
+        for (int i = 0; i < len; ++i) d[i] = rev[len - 1 - i];
+        exp = len - k;
+        n = len;
+      }
+      const auto first = a < std::numeric_limits<Number>::min() ? 1 : 15;
+      if (!n) for (int precision = first; precision <= 17; ++precision) {
+        char sci[SIZE], check[SIZE];
+        std::snprintf(sci, sizeof(sci), "%.*e", precision - 1, a);
+        n = 0;
+        const char *c = sci;
+        for (; *c && *c != 'e'; ++c) if (*c >= '0' && *c <= '9') d[n++] = *c; // Skips the (locale's) point.
+        exp = std::atoi(c + 1) + 1;
+        std::memcpy(check, d, static_cast<size_t>(n)); // ddd e(exp - n), e.g. 123e-5 for 0.00123
+        std::snprintf(check + n, sizeof(check) - static_cast<size_t>(n), "e%d", exp - n);
+        if (std::strtod(check, nullptr) == a) break;
+      }
+      while (n > 1 && d[n - 1] == '0') --n;
+      return digits(d, n, exp, negative, buf);
+    }
+
+    /**
+     Writes columns as CSV, with a header row.
+
+     @param[out] out
+     @param[in] names Column names
+     @param[in] columns Column per name
+     @param[in] rows
+     @param[in] separator
+     */
+    inline void csv(std::ostream &out, const std::vector<std::string> &names, const Number *const *columns, const size_t rows, const char separator = ',') {
+      char buf[SIZE];
+      for (size_t c = 0; c < names.size(); ++c) out << (c ? std::string(1, separator) : "") << names[c];
+      out << '\n';
+      for (size_t r = 0; r < rows; ++r) {
+        for (size_t c = 0; c < names.size(); ++c) {
+          if (c) out.put(separator);
+          out.write(buf, static_cast<std::streamsize>(number(columns[c][r], buf)));
+        }
+        out.put('\n');
+      }
+    }
+
+    /**
+     Writes columns as newline-delimited JSON, one object per row. Non-finite numbers (which JSON can't hold)
+     are written as null.
+
+     @param[out] out
+     @param[in] names Field names
+     @param[in] columns Column per name
+     @param[in] rows
+     */
+    inline void ndjson(std::ostream &out, const std::vector<std::string> &names, const Number *const *columns, const size_t rows) {
+      char buf[SIZE];
+      for (size_t r = 0; r < rows; ++r) {
+        out.put('{');
+        for (size_t c = 0; c < names.size(); ++c) {
+          out << (c ? ",\"" : "\"") << names[c] << "\":";
+          if (std::isfinite(columns[c][r])) out.write(buf, static_cast<std::streamsize>(number(columns[c][r], buf)));
+          else out << "null";
+        }
+        out << "}\n";
+      }
+    }
+  }
+
 #pragma mark - Type Checking
   namespace Type {
     inline Token toToken(const Number n) {return std::to_string(n);}
-    inline Number toNumber(const BaseVal &s) {return std::stod(s);}
+    inline Number toNumber(const BaseVal &s) {
+      Number n;
+      const auto end = s.data() + s.size();
+      if (Parse::fast(s.data(), end, n) == end) return n; // Anything else keeps `stod`'s exact behavior.
+      return std::stod(s);
+    }
     inline bool isNumber(const Token &s) {
       if (s.empty()) return false;
       // The most common case is whole numbers (where every char is a digit).
@@ -166,6 +520,40 @@ namespace jgod { namespace _eval { // Make it clear that this is an implementati
     inline Number hypot(FnArgs args) {EVAL_FN_IMPL_2NUMBERS("hypot", std::hypot);}
   }
 
+#pragma mark - Natives
+  // Numeric-only twins of `Builtins`. They never touch strings, the heap or exceptions, so they're
+  // what compiled programs call, and the only functions allowed in real-time mode.
+  typedef Number (*NativeFn)(const Number *args);
+  struct Native {const char *name; size_t arity; NativeFn fn;};
+
+  namespace Natives {
+    EVAL_DEF_NATIVE_FN(abs);
+    EVAL_DEF_NATIVE_FN(sqrt); EVAL_DEF_NATIVE_FN(cbrt);
+    EVAL_DEF_NATIVE_FN(sin); EVAL_DEF_NATIVE_FN(cos); EVAL_DEF_NATIVE_FN(tan);
+    EVAL_DEF_NATIVE_FN(asin); EVAL_DEF_NATIVE_FN(acos); EVAL_DEF_NATIVE_FN(atan);
+    EVAL_DEF_NATIVE_FN(floor); EVAL_DEF_NATIVE_FN(ceil); EVAL_DEF_NATIVE_FN(trunc); EVAL_DEF_NATIVE_FN(round);
+    inline Number hypot(const Number *args) {return std::hypot(args[0], args[1]);}
+  }
+
+  // Instructions refer to natives by index into this table (not by pointer), which keeps programs position-independent.
+  inline const std::vector<Native> &natives() {
+    static const std::vector<Native> table = {
+      EVAL_NATIVE(abs, 1),
+      EVAL_NATIVE(sqrt, 1), EVAL_NATIVE(cbrt, 1),
+      EVAL_NATIVE(sin, 1), EVAL_NATIVE(cos, 1), EVAL_NATIVE(tan, 1),
+      EVAL_NATIVE(asin, 1), EVAL_NATIVE(acos, 1), EVAL_NATIVE(atan, 1),
+      EVAL_NATIVE(floor, 1), EVAL_NATIVE(ceil, 1), EVAL_NATIVE(trunc, 1), EVAL_NATIVE(round, 1),
+      EVAL_NATIVE(hypot, 2)
+    };
+    return table;
+  }
+
+  inline size_t findNative(const std::string &name) {
+    const auto &table = natives();
+    for (size_t i = 0; i < table.size(); ++i) if (name == table[i].name) return i;
+    return std::string::npos;
+  }
+
 #pragma mark - Utils
   inline std::string replaceAll(std::string s, const std::string &search, const std::string &r) {
     size_t pos = 0;
@@ -176,6 +564,12 @@ namespace jgod { namespace _eval { // Make it clear that this is an implementati
     return s;
   }
 
+  // FNV-1a
+  inline uint64_t hash(const char *data, const size_t size, uint64_t h = 14695981039346656037ull) {
+    for (size_t i = 0; i < size; ++i) h = (h ^ static_cast<unsigned char>(data[i]))*1099511628211ull;
+    return h;
+  }
+
 #pragma mark - Evaluation
   /**
    Rewrites an expression to something that can be tokenized easier.
@@ -232,6 +626,7 @@ namespace jgod { namespace _eval { // Make it clear that this is an implementati
       // Single-character only tokens: operators and parenthesis
       if (Type::isOperator(c) || Type::isParenthesis(c) || Type::isFunctionSeperator(c)) {
         if (c == '(') number.inContext = false; // Starting new context, reset any flags.
+        else if (c == ')') number.inContext = true; // A closed context is a value in the enclosing one.
         else if (Op::isUnary(c) && wip.empty() && !number.inContext) {
           // If a valid unary (+/-) is before any numbers in a context (e.g. (-2 + 3)),
           // prepend an explicit 0 as an easy solution.
@@ -252,7 +647,10 @@ namespace jgod { namespace _eval { // Make it clear that this is an implementati
             return valid;
           });
         }
-        else if (Type::isLetter(c)) MULTI_CHAR_IMPL(c, [&](){return Type::containsLettersOnly(wip);});
+        else if (Type::isLetter(c)) {
+          MULTI_CHAR_IMPL(c, [&](){return Type::containsLettersOnly(wip);});
+          number.inContext = true; // Variables are numbers too.
+        }
         else FINISH_PREV();
       }
     }
@@ -261,6 +659,17 @@ namespace jgod { namespace _eval { // Make it clear that this is an implementati
     return toks;
   }
 
+  /**
+   Strips whitespace, rewrites and tokenizes an expression; everything up to parsing.
+
+   @param[in] exp
+   @returns tokens
+   */
+  inline const Tokens lex(std::string exp) {
+    exp.erase(std::remove(std::begin(exp), std::end(exp), ' '), std::end(exp)); // Remove whitespace.
+    return tokenize(rewriteExpression(exp));
+  }
+
   /**
    Reads a string into RPN, following the Shunting-yard algorithm.
 
@@ -399,23 +808,2654 @@ namespace jgod { namespace _eval { // Make it clear that this is an implementati
     EVAL_BIND_INCL_FN(floor); EVAL_BIND_INCL_FN(ceil); EVAL_BIND_INCL_FN(trunc); EVAL_BIND_INCL_FN(round);
     EVAL_BIND_INCL_FN(hypot);
   }
-}
 
-/**
- Evaluates a string by tokenizing, creating an RPN stack, and evaluating it.
+#pragma mark - Compilation
+  // Store pops a value into a temporary register and Load pushes it back; registers sit above the stack.
+  enum class Opcode : size_t {Const, Slot, Add, Sub, Mul, Div, Pow, Mod, Native, Call, Store, Load}; // Word-sized, so Instr has no padding
+  struct Instr {Opcode op; size_t arity; size_t idx;}; // idx is a constant, slot, native, user function or register index.
 
- @param[in] str
- @param[in] vars Custom in-place variables (optional)
- @param[in] fns Functions (optional)
- @returns result
- */
-inline _eval::Number eval(std::string str,
-                          _eval::VarMap vars = _eval::VarMap(),
-                          _eval::FnMap fns = _eval::FnMap()) {
-  str.erase(std::remove(std::begin(str), std::end(str), ' '), std::end(str)); // Remove whitespace.
-  if (str.empty()) return 0; // "null" evaluates to 0.
-  _eval::bindBuiltins(vars, fns);
-  auto q = _eval::read(_eval::rewriteExpression(str), vars, fns);
-  return _eval::queue(q);
+  enum class Mode {
+    Default,
+    Realtime // Only natives may be called, so running the program never allocates, locks or throws.
+  };
+
+  /**
+   A precompiled expression: RPN instructions over constants and variable slots.
+   Names are resolved once when compiling, so running a program never looks anything up.
+   */
+  struct Program {
+    std::vector<Instr> code;
+    std::vector<Number> consts;
+    std::vector<std::string> vars; // Referenced variables; a variable's index here is its slot.
+    std::vector<std::string> fnNames; // User functions, called through strings like `eval()` does.
+    std::vector<Fn> fns;
+    size_t depth = 0; // Deepest the value stack gets while running, plus temporary registers.
+    std::vector<std::string> outputs; // Named results of a multi-statement program, kept in the top registers.
+
+    bool realtime() const {return fns.empty();}
+    size_t outputRegister(const size_t i) const {return depth - outputs.size() + i;}
+    size_t slot(const std::string &name) const {
+      const auto it = std::find(std::begin(vars), std::end(vars), name);
+      return it == std::end(vars) ? std::string::npos : static_cast<size_t>(it - std::begin(vars));
+    }
+  };
+
+  // A function defined in the expression language, like "f(x, y) = x^2 + y"; calls to it get inlined.
+  struct Definition {std::vector<std::string> params; Program body;};
+  typedef std::map<std::string, Definition> Definitions;
+
+  inline Program inlineCalls(const Program &p, const Definitions &defs);
+
+  inline Opcode toOpcode(const OpType &s) {
+    if (s == "+") return Opcode::Add;
+    else if (s == "-") return Opcode::Sub;
+    else if (s == "*") return Opcode::Mul;
+    else if (s == "/") return Opcode::Div;
+    else if (s == "^") return Opcode::Pow;
+    else if (s == "%") return Opcode::Mod;
+    throw EVAL_UNREC_OP;
+  }
+
+  inline Number binary(const Opcode op, const Number L, const Number R) {
+    switch (op) {
+      case Opcode::Add: return L + R;
+      case Opcode::Sub: return L - R;
+      case Opcode::Mul: return L*R;
+      case Opcode::Div: return L/R;
+      case Opcode::Pow: return std::pow(L, R);
+      // Same as `eval()`'s integer modulo, minus the undefined behavior on zero or out of range operands.
+      case Opcode::Mod: return std::fmod(std::trunc(L), std::trunc(R));
+      case Opcode::Const: case Opcode::Slot: case Opcode::Native: case Opcode::Call: case Opcode::Store: case Opcode::Load: break;
+    }
+    return std::nan("");
+  }
+
+  /**
+   Compiles tokens into a program, following the Shunting-yard algorithm like `read()` does, except that
+   function arguments may be whole expressions.
+
+   @param[in] tokens
+   @param[in] fns User functions (optional)
+   @param[in] mode
+   @returns program
+   */
+  inline Program compile(const Tokens &tokens, FnMap fns = FnMap(), const Mode mode = Mode::Default, const Definitions &defs = Definitions()) {
+    struct Frame {Token token; size_t commas; size_t mark;}; // mark: code size when a "(" was pushed
+    Program p;
+    std::stack<Frame> opStack;
+    size_t depth = 0;
+    auto inlined = false;
+
+    const auto EMIT = [&](const Instr instr, const size_t pops) {
+      if (depth < pops) throw EVAL_INVALID_EXPR;
+      depth = depth - pops + 1;
+      p.depth = std::max(p.depth, depth);
+      p.code.push_back(instr);
+    };
+    const auto EMIT_CONST = [&](const Number n) {
+      p.consts.push_back(n);
+      EMIT({Opcode::Const, 0, p.consts.size() - 1}, 0);
+    };
+    const auto EMIT_CALL = [&](const Token &name, const size_t argc) {
+      const auto native = findNative(name);
+      if (native != std::string::npos) {
+        if (natives()[native].arity != argc) throw EVAL_INVALID_NATIVE_NUMBER_ARGS(name, natives()[native].arity, argc);
+        return EMIT({Opcode::Native, argc, native}, argc);
+      }
+      const auto def = defs.find(name);
+      if (def != std::end(defs)) {
+        if (def->second.params.size() != argc) throw EVAL_INVALID_NATIVE_NUMBER_ARGS(name, def->second.params.size(), argc);
+        inlined = true;
+      }
+      auto it = std::find(std::begin(p.fnNames), std::end(p.fnNames), name);
+      if (it == std::end(p.fnNames)) {p.fnNames.push_back(name); p.fns.push_back(def == std::end(defs) ? fns[name] : Fn()); it = std::end(p.fnNames) - 1;}
+      EMIT({Opcode::Call, argc, static_cast<size_t>(it - std::begin(p.fnNames))}, argc);
+    };
+    const auto IS_FN = [](const Frame &f) {return !f.token.empty() && Type::containsLettersOnly(f.token);};
+    const auto POP_UNTIL_LEFT_PAREN = [&]() {
+      while (!opStack.empty() && opStack.top().token != "(") {
+        EMIT({toOpcode(opStack.top().token), 2, 0}, 2); opStack.pop();
+      }
+      if (opStack.empty()) throw EVAL_MISMATCHED_PARENS;
+    };
+
+    for (size_t i = 0; i < tokens.size(); ++i) {
+      const auto &token = tokens[i];
+      if (Type::isNumber(token)) EMIT_CONST(Type::toNumber(token));
+      else if (Type::isOperator(token)) {
+        while (!opStack.empty() && Type::isOperator(opStack.top().token)
+               && ((Op::isLHS(token) && (Op::getPriority(token) <= Op::getPriority(opStack.top().token)))
+                   || (Op::isRHS(token) && (Op::getPriority(token) < Op::getPriority(opStack.top().token))))) {
+          EMIT({toOpcode(opStack.top().token), 2, 0}, 2); opStack.pop();
+        }
+        opStack.push({token, 0, 0});
+      }
+      else if (token == "(") opStack.push({token, 0, p.code.size()});
+      else if (Type::isFunctionSeperator(token)) {
+        POP_UNTIL_LEFT_PAREN();
+        opStack.top().commas++;
+      }
+      else if (token == ")") {
+        POP_UNTIL_LEFT_PAREN();
+        const auto paren = opStack.top(); opStack.pop();
+        if (!opStack.empty() && IS_FN(opStack.top())) {
+          EMIT_CALL(opStack.top().token, paren.commas + (p.code.size() > paren.mark ? 1 : 0));
+          opStack.pop();
+        } else if (paren.commas) throw EVAL_INVALID_FN_INVOCATION;
+      }
+      else if (Type::containsLettersOnly(token)) {
+        const auto call = i + 1 < tokens.size() && tokens[i + 1] == "(";
+        if (call && (findNative(token) != std::string::npos || defs.count(token))) opStack.push({token, 0, 0});
+        else if (call && fns.count(token)) {
+          if (mode == Mode::Realtime) throw EVAL_NOT_REALTIME_SAFE(token);
+          opStack.push({token, 0, 0});
+        }
+        else if (token == "pi") EMIT_CONST(Builtins::pi());
+        else {
+          auto slot = p.slot(token);
+          if (slot == std::string::npos) {p.vars.push_back(token); slot = p.vars.size() - 1;}
+          EMIT({Opcode::Slot, 0, slot}, 0);
+        }
+      }
+      else throw EVAL_UNREC_TOKEN(token);
+    }
+
+    while (!opStack.empty()) {
+      if (opStack.top().token == "(" || IS_FN(opStack.top())) throw EVAL_MISMATCHED_PARENS;
+      EMIT({toOpcode(opStack.top().token), 2, 0}, 2); opStack.pop();
+    }
+    if (depth == 0) EMIT_CONST(0); // "null" evaluates to 0.
+    else if (depth > 1) throw EVAL_INPUT_TOO_MANY_VALS;
+    if (p.depth > EVAL_MAX_DEPTH) throw EVAL_TOO_DEEP;
+    if (!inlined) return p;
+    auto q = inlineCalls(p, defs);
+    if (mode == Mode::Realtime && !q.realtime()) throw EVAL_NOT_REALTIME_SAFE(q.fnNames.front());
+    return q;
+  }
+
+  /**
+   Runs a compiled program.
+   For real-time programs this doesn't allocate, lock or throw, and takes time proportional to the program's length.
+
+   @param[in] p
+   @param[in] slots Variable values, indexed like `p.vars`
+   @param[out] outputs Values of `p.outputs` (optional)
+   @returns result (the first output, with several)
+   */
+  inline Number run(const Program &p, const Number *slots, Number *outputs = nullptr) {
+    Number stack[EVAL_MAX_DEPTH];
+    size_t top = 0;
+    for (const auto &instr : p.code) {
+      switch (instr.op) {
+        case Opcode::Const: stack[top++] = p.consts[instr.idx]; break;
+        case Opcode::Slot: stack[top++] = slots[instr.idx]; break;
+        case Opcode::Native:
+          top -= instr.arity;
+          stack[top] = natives()[instr.idx].fn(stack + top); ++top;
+          break;
+        case Opcode::Call: {
+          top -= instr.arity;
+          FnArgs args;
+          for (size_t k = 0; k < instr.arity; ++k) args.push_back(Type::toToken(stack[top + k]));
+          stack[top++] = p.fns[instr.idx](args);
+          break;
+        }
+        case Opcode::Store: stack[instr.idx] = stack[--top]; break;
+        case Opcode::Load: stack[top++] = stack[instr.idx]; break;
+        case Opcode::Add: case Opcode::Sub: case Opcode::Mul: case Opcode::Div: case Opcode::Pow: case Opcode::Mod:
+          --top; stack[top - 1] = binary(instr.op, stack[top - 1], stack[top]);
+          break;
+      }
+    }
+    if (outputs) for (size_t i = 0; i < p.outputs.size(); ++i) outputs[i] = stack[p.outputRegister(i)];
+    return stack[0];
+  }
+
+#pragma mark - Canonicalization
+  // A program as a tree, for rewriting. Leaves are constants and slots.
+  struct Node {
+    Instr instr;
+    Number value; // Constant's value
+    std::string name; // Slot's or user function's name
+    std::vector<Node> kids;
+  };
+
+  // One tree per output (or just the result). Temporaries are expanded back into copies of the subtree they hold.
+  inline std::vector<Node> toTrees(const Program &p) {
+    std::vector<Node> stack;
+    std::map<size_t, Node> registers;
+    for (const auto &instr : p.code) {
+      if (instr.op == Opcode::Store) {registers[instr.idx] = std::move(stack.back()); stack.pop_back(); continue;}
+      if (instr.op == Opcode::Load) {stack.push_back(registers[instr.idx]); continue;}
+      Node n = {instr, 0, "", {}};
+      if (instr.op == Opcode::Const) n.value = p.consts[instr.idx];
+      else if (instr.op == Opcode::Slot) n.name = p.vars[instr.idx];
+      else if (instr.op == Opcode::Call) n.name = p.fnNames[instr.idx];
+      const auto first = stack.end() - static_cast<std::ptrdiff_t>(instr.arity);
+      n.kids.assign(std::make_move_iterator(first), std::make_move_iterator(stack.end()));
+      stack.erase(first, stack.end());
+      stack.push_back(std::move(n));
+    }
+    if (p.outputs.empty()) return std::vector<Node>(1, std::move(stack.back()));
+    std::vector<Node> roots;
+    for (size_t i = 0; i < p.outputs.size(); ++i) roots.push_back(std::move(registers[p.outputRegister(i)]));
+    return roots;
+  }
+  inline Node toTree(const Program &p) {return std::move(toTrees(p).front());}
+
+  // Hash of a node given its kids' hashes, for hashing a whole tree bottom-up in one pass.
+  inline uint64_t structuralHash(const Node &n, const uint64_t *kidHashes) {
+    uint64_t h[] = {static_cast<uint64_t>(n.instr.op), n.instr.op == Opcode::Native || n.instr.op == Opcode::Load ? n.instr.idx : 0, 0};
+    std::memcpy(&h[2], &n.value, sizeof(Number));
+    auto result = hash(reinterpret_cast<const char*>(h), sizeof(h));
+    result = hash(n.name.c_str(), n.name.size() + 1, result);
+    for (size_t k = 0; k < n.kids.size(); ++k) result = hash(reinterpret_cast<const char*>(&kidHashes[k]), sizeof(uint64_t), result);
+    return result;
+  }
+  inline uint64_t structuralHash(const Node &n) {
+    std::vector<uint64_t> kids;
+    for (const auto &k : n.kids) kids.push_back(structuralHash(k));
+    return structuralHash(n, kids.data());
+  }
+
+  inline int compare(const Node &a, const Node &b);
+
+  inline bool callsFunctions(const Node &n) {
+    return n.instr.op == Opcode::Call || std::any_of(std::begin(n.kids), std::end(n.kids), callsFunctions);
+  }
+
+  // Common subexpressions: repeated subtrees get computed once, into a temporary register.
+  class Cse {
+    struct Seen {const Node *node; size_t uses; size_t temp;};
+    std::multimap<uint64_t, Seen> seen;
+
+  public:
+    size_t temps = 0;
+
+    Seen *find(const Node &n) {
+      const auto range = seen.equal_range(structuralHash(n));
+      for (auto it = range.first; it != range.second; ++it) if (compare(*it->second.node, n) == 0) return &it->second;
+      return nullptr;
+    }
+    // Counts uses of every pure operation in a tree; repeats aren't descended into, since they'll be loaded.
+    void count(const Node &n) {
+      if (n.kids.empty()) return;
+      if (!callsFunctions(n)) {
+        if (const auto s = find(n)) {++s->uses; return;}
+        seen.insert(std::make_pair(structuralHash(n), Seen{&n, 1, std::string::npos}));
+      }
+      for (const auto &k : n.kids) count(k);
+    }
+  };
+
+  /**
+   Appends a tree's instructions to a program, pooling constants and numbering slots and user functions in
+   order of first use. With `cse`, subtrees it counted more than once are stored to temporary registers
+   (numbered from 0 here; see `canonical()`).
+
+   @param[in] n
+   @param[in,out] p
+   @param[in] from Program the tree's user functions come from
+   @param[in] height Values on the stack below this node
+   @param[in,out] cse (optional)
+   */
+  inline void emit(const Node &n, Program &p, const Program &from, const size_t height = 0, Cse *cse = nullptr) {
+    const auto shared = cse && !n.kids.empty() ? cse->find(n) : nullptr;
+    if (shared && shared->uses > 1 && shared->temp != std::string::npos) {
+      p.code.push_back({Opcode::Load, 0, shared->temp});
+      p.depth = std::max(p.depth, height + 1);
+      return;
+    }
+    for (size_t k = 0; k < n.kids.size(); ++k) emit(n.kids[k], p, from, height + k, cse);
+    auto instr = n.instr;
+    if (instr.op == Opcode::Const) {
+      const auto it = std::find_if(std::begin(p.consts), std::end(p.consts), [&](const Number c) {return std::memcmp(&c, &n.value, sizeof(c)) == 0;});
+      instr.idx = static_cast<size_t>(it - std::begin(p.consts));
+      if (it == std::end(p.consts)) p.consts.push_back(n.value);
+    }
+    else if (instr.op == Opcode::Slot) {
+      instr.idx = p.slot(n.name);
+      if (instr.idx == std::string::npos) {instr.idx = p.vars.size(); p.vars.push_back(n.name);}
+    }
+    else if (instr.op == Opcode::Call) {
+      const auto it = std::find(std::begin(p.fnNames), std::end(p.fnNames), n.name);
+      instr.idx = static_cast<size_t>(it - std::begin(p.fnNames));
+      if (it == std::end(p.fnNames)) {
+        p.fnNames.push_back(n.name);
+        p.fns.push_back(from.fns[static_cast<size_t>(std::find(std::begin(from.fnNames), std::end(from.fnNames), n.name) - std::begin(from.fnNames))]);
+      }
+    }
+    p.code.push_back(instr);
+    p.depth = std::max(p.depth, height + 1);
+    if (shared && shared->uses > 1) {
+      shared->temp = cse->temps++;
+      p.code.push_back({Opcode::Store, 0, shared->temp});
+      p.code.push_back({Opcode::Load, 0, shared->temp});
+    }
+  }
+
+  // Total order on trees: constants (by bits), then slots (by name), then operations.
+  inline int compare(const Node &a, const Node &b) {
+    if (a.instr.op != b.instr.op) return a.instr.op < b.instr.op ? -1 : 1;
+    if (a.instr.op == Opcode::Const) {
+      uint64_t x, y;
+      std::memcpy(&x, &a.value, sizeof(x)); std::memcpy(&y, &b.value, sizeof(y));
+      if (x != y) return x < y ? -1 : 1;
+    }
+    if (a.name != b.name) return a.name < b.name ? -1 : 1;
+    if ((a.instr.op == Opcode::Native || a.instr.op == Opcode::Load) && a.instr.idx != b.instr.idx) return a.instr.idx < b.instr.idx ? -1 : 1;
+    if (a.kids.size() != b.kids.size()) return a.kids.size() < b.kids.size() ? -1 : 1;
+    for (size_t k = 0; k < a.kids.size(); ++k) if (const auto c = compare(a.kids[k], b.kids[k])) return c;
+    return 0;
+  }
+
+  inline bool commutes(const Opcode op) {return op == Opcode::Add || op == Opcode::Mul;}
+
+  // Folds constant subtrees and orders commutative operands; see `canonical()`.
+  inline void canonicalize(Node &n, const bool reassociate) {
+    for (auto &k : n.kids) canonicalize(k, reassociate);
+    const auto op = n.instr.op;
+    const auto isConst = [](const Node &k) {return k.instr.op == Opcode::Const;};
+    if (op != Opcode::Call && !n.kids.empty() && std::all_of(std::begin(n.kids), std::end(n.kids), isConst)) {
+      Number args[2] = {n.kids[0].value, n.kids.size() > 1 ? n.kids[1].value : 0};
+      n.value = op == Opcode::Native ? natives()[n.instr.idx].fn(args) : binary(op, args[0], args[1]);
+      n.instr = {Opcode::Const, 0, 0};
+      n.kids.clear();
+      return;
+    }
+    if (!commutes(op) || callsFunctions(n)) return; // User functions may have side effects, so they're called in order.
+    const auto less = [](const Node &a, const Node &b) {return compare(a, b) < 0;};
+    if (!reassociate) {std::sort(std::begin(n.kids), std::end(n.kids), less); return;}
+
+    std::vector<Node> operands;
+    std::function<void(Node&)> gather = [&](Node &k) {
+      if (k.instr.op == op) for (auto &kk : k.kids) gather(kk);
+      else operands.push_back(std::move(k));
+    };
+    for (auto &k : n.kids) gather(k);
+    std::sort(std::begin(operands), std::end(operands), less);
+    size_t consts = 0; // Sorted first, so they fold into one.
+    while (consts + 1 < operands.size() && isConst(operands[consts]) && isConst(operands[consts + 1])) {
+      operands[consts + 1].value = binary(op, operands[consts].value, operands[consts + 1].value);
+      ++consts;
+    }
+    operands.erase(std::begin(operands), std::begin(operands) + static_cast<std::ptrdiff_t>(consts));
+    if (operands.size() == 1) {n = std::move(operands[0]); return;}
+    Node chain = std::move(operands[0]);
+    for (size_t i = 1; i < operands.size(); ++i) {
+      Node next = {n.instr, 0, "", {}};
+      next.kids.push_back(std::move(chain));
+      next.kids.push_back(std::move(operands[i]));
+      chain = std::move(next);
+    }
+    n = std::move(chain);
+  }
+
+  /**
+   Rewrites a program into a canonical form, so the same formula written different ways (`2*x` and `x*2`,
+   `(a+b)+c` and `c+(b+a)`, redundant parentheses) compiles to the same program: constant subtrees are
+   folded, commutative operands are sorted and slots are renumbered in order of first use. Repeated
+   subtrees without user function calls are computed once; operands that call user functions keep their order.
+   With several outputs, subtrees are shared across all of them.
+   Results are bit-for-bit the same, except with `reassociate`, which also flattens chains of `+` or `*`
+   before sorting (so `a+(b+c)` matches `(a+b)+c`); floating point addition and multiplication aren't
+   associative, so that can change rounding.
+
+   @param[in] p
+   @param[in] reassociate
+   @param[in] temps Temporary each root is stored to instead of being an output (npos for outputs), for values
+                    other roots load (as `Load` leaves) rather than recompute (optional)
+   @returns program
+   */
+  inline Program canonical(std::vector<Node> roots, const Program &from, const std::vector<std::string> &outputs = {}, const bool reassociate = false,
+                           const std::vector<size_t> &temps = {}) {
+    Cse cse;
+    for (auto &root : roots) {canonicalize(root, reassociate); cse.count(root);}
+    for (const auto t : temps) if (t != std::string::npos) cse.temps = std::max(cse.temps, t + 1);
+    Program c;
+    std::vector<size_t> stores; // Output stores, with several outputs
+    for (size_t r = 0; r < roots.size(); ++r) {
+      emit(roots[r], c, from, 0, &cse);
+      if (r < temps.size() && temps[r] != std::string::npos) c.code.push_back({Opcode::Store, 0, temps[r]});
+      else if (!outputs.empty()) {stores.push_back(c.code.size()); c.code.push_back({Opcode::Store, 0, 0});}
+    }
+    // Temporaries share registers: one is free again after its last load (a linear scan, since code is straight-line).
+    std::vector<size_t> last(cse.temps), reg(cse.temps), free;
+    size_t regs = 0;
+    for (size_t i = 0; i < c.code.size(); ++i) if (c.code[i].op == Opcode::Load) last[c.code[i].idx] = i;
+    for (size_t i = 0, s = 0; i < c.code.size(); ++i) {
+      auto &instr = c.code[i];
+      if (s < stores.size() && stores[s] == i) {++s; continue;} // Outputs get their own registers.
+      if (instr.op == Opcode::Store) {
+        if (free.empty()) reg[instr.idx] = regs++;
+        else {reg[instr.idx] = free.back(); free.pop_back();}
+        instr.idx = reg[instr.idx];
+      }
+      else if (instr.op == Opcode::Load) {
+        if (last[instr.idx] == i) free.push_back(reg[instr.idx]);
+        instr.idx = reg[instr.idx];
+      }
+    }
+    for (auto &instr : c.code) if (instr.op == Opcode::Store || instr.op == Opcode::Load) instr.idx += c.depth;
+    c.depth += regs + outputs.size();
+    c.outputs = outputs;
+    for (size_t i = 0; i < stores.size(); ++i) c.code[stores[i]].idx = c.outputRegister(i);
+    if (!outputs.empty()) c.code.push_back({Opcode::Load, 0, c.outputRegister(0)}); // The first output is the result.
+    if (c.depth > EVAL_MAX_DEPTH) throw EVAL_TOO_DEEP;
+    return c;
+  }
+  inline Program canonical(const Program &p, const bool reassociate = false) {return canonical(toTrees(p), p, p.outputs, reassociate);}
+
+  inline void substitute(Node &n, const std::vector<std::string> &params, const std::vector<Node> &args) {
+    if (n.instr.op == Opcode::Slot) {
+      const auto it = std::find(std::begin(params), std::end(params), n.name);
+      if (it != std::end(params)) n = args[static_cast<size_t>(it - std::begin(params))];
+      return;
+    }
+    for (auto &k : n.kids) substitute(k, params, args);
+  }
+
+  /**
+   Replaces calls to functions defined in the language with their bodies, then optimizes across the call
+   boundaries (constant folding and common subexpressions; see `canonical()`).
+
+   @param[in] p
+   @param[in] defs
+   @returns program
+   */
+  inline Program inlineCalls(const Program &p, const Definitions &defs) {
+    std::function<void(Node&)> expand = [&](Node &n) {
+      for (auto &k : n.kids) expand(k);
+      if (n.instr.op != Opcode::Call) return;
+      const auto def = defs.find(n.name);
+      if (def == std::end(defs)) return;
+      auto body = toTree(def->second.body); // Already inlined when it was defined
+      substitute(body, def->second.params, n.kids);
+      n = std::move(body);
+    };
+    auto root = toTree(p);
+    expand(root);
+    auto from = p; // Bodies' user functions are called from here now.
+    for (const auto &def : defs) for (size_t f = 0; f < def.second.body.fnNames.size(); ++f) {
+      const auto &name = def.second.body.fnNames[f];
+      if (std::find(std::begin(from.fnNames), std::end(from.fnNames), name) == std::end(from.fnNames)) {from.fnNames.push_back(name); from.fns.push_back(def.second.body.fns[f]);}
+    }
+    return canonical(std::vector<Node>(1, std::move(root)), from);
+  }
+
+  /**
+   Defines a function in the expression language, e.g. "f(x, y) = x^2 + y". The body can call earlier
+   definitions, natives and `fns`; variables that aren't parameters are the caller's.
+
+   @param[in,out] defs
+   @param[in] str
+   @param[in] fns Functions (optional)
+   */
+  inline void define(Definitions &defs, std::string str, FnMap fns = FnMap()) {
+    str.erase(std::remove(std::begin(str), std::end(str), ' '), std::end(str));
+    const auto open = str.find('('), close = str.find(')'), eq = str.find('=');
+    if (open == std::string::npos || close == std::string::npos || close < open || close + 1 != eq) throw EVAL_INVALID_DEFINITION(str);
+    const auto name = str.substr(0, open);
+    const auto valid = [](const std::string &id) {return !id.empty() && Type::containsLettersOnly(id) && id != "pi" && findNative(id) == std::string::npos;};
+    if (!valid(name)) throw EVAL_INVALID_DEFINITION(str);
+    Definition def;
+    std::istringstream params(str.substr(open + 1, close - open - 1));
+    for (std::string param; std::getline(params, param, ',');) {
+      if (!valid(param) || std::count(std::begin(def.params), std::end(def.params), param)) throw EVAL_INVALID_DEFINITION(str);
+      def.params.push_back(param);
+    }
+    def.body = compile(lex(str.substr(eq + 1)), fns, Mode::Default, defs);
+    defs[name] = def;
+  }
+
+  /**
+   Compiles statements like "t = a*b; u = t + c; ratio = t/u; root = sqrt(u)" into one program. Names
+   assigned and used by later statements are locals; the rest are the program's outputs, in order. Locals
+   are inlined and then shared as common subexpressions, so each is still computed once; locals calling
+   user functions are instead computed once into a temporary, in statement order.
+
+   @param[in] str
+   @param[in] defs (optional)
+   @param[in] fns Functions (optional)
+   @param[in] mode (optional)
+   @returns program
+   */
+  inline Program compileStatements(const std::string &str, const Definitions &defs = Definitions(), FnMap fns = FnMap(), const Mode mode = Mode::Default) {
+    std::vector<std::string> names; // Per statement, in order
+    std::vector<Node> values;
+    std::vector<bool> used, latest;
+    std::vector<size_t> temps;
+    Program from; // Every statement's user functions
+    // Replaces references to earlier statements with their values (or a load of their temporary).
+    std::function<void(Node&)> resolve = [&](Node &n) {
+      if (n.instr.op == Opcode::Slot) {
+        for (size_t i = 0; i < names.size(); ++i) {
+          if (!latest[i] || names[i] != n.name) continue;
+          used[i] = true;
+          if (!callsFunctions(values[i])) {n = values[i]; return;}
+          if (temps[i] == std::string::npos) temps[i] = static_cast<size_t>(std::count_if(std::begin(temps), std::end(temps), [](size_t t) {return t != std::string::npos;}));
+          n = {{Opcode::Load, 0, temps[i]}, 0, "", {}};
+          return;
+        }
+        return;
+      }
+      for (auto &k : n.kids) resolve(k);
+    };
+
+    std::istringstream in(str);
+    for (std::string statement; std::getline(in, statement, ';');) {
+      statement.erase(std::remove_if(std::begin(statement), std::end(statement), [](const char c) {return std::isspace(static_cast<unsigned char>(c));}), std::end(statement));
+      if (statement.empty()) continue;
+      const auto eq = statement.find('=');
+      const auto name = statement.substr(0, std::min(eq, statement.size()));
+      if (eq == std::string::npos || eq + 1 == statement.size() || name.empty() || !Type::containsLettersOnly(name) || name == "pi") {
+        throw EVAL_INVALID_STATEMENT(statement);
+      }
+      const auto p = compile(lex(statement.substr(eq + 1)), fns, mode, defs);
+      for (size_t f = 0; f < p.fnNames.size(); ++f) {from.fnNames.push_back(p.fnNames[f]); from.fns.push_back(p.fns[f]);}
+      auto value = toTree(p);
+      resolve(value);
+      for (size_t i = 0; i < names.size(); ++i) if (names[i] == name) latest[i] = false; // Reassigned: later statements see the new value.
+      names.push_back(name); values.push_back(std::move(value)); used.push_back(false); latest.push_back(true); temps.push_back(std::string::npos);
+    }
+    if (names.empty()) throw EVAL_INVALID_EXPR;
+
+    std::vector<std::string> outputs;
+    std::vector<Node> roots;
+    std::vector<size_t> rootTemps;
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (temps[i] != std::string::npos) {roots.push_back(std::move(values[i])); rootTemps.push_back(temps[i]);}
+      else if (!used[i] && latest[i]) {outputs.push_back(names[i]); roots.push_back(std::move(values[i])); rootTemps.push_back(std::string::npos);}
+    }
+    return canonical(std::move(roots), from, outputs, false, rootTemps);
+  }
+
+  /**
+   Hashes a program's structure. Hash `canonical()` programs to find formulas that are the same however
+   they were written, e.g. to deduplicate a formula library.
+   */
+  inline uint64_t structuralHash(const Program &p) {
+    auto h = hash(nullptr, 0);
+    for (const auto &instr : p.code) {
+      const uint64_t packed[] = {static_cast<uint64_t>(instr.op), instr.arity, instr.idx};
+      h = hash(reinterpret_cast<const char*>(packed), sizeof(packed), h);
+    }
+    h = hash(reinterpret_cast<const char*>(p.consts.data()), p.consts.size()*sizeof(Number), h);
+    for (const auto &name : p.vars) h = hash(name.c_str(), name.size() + 1, h);
+    for (const auto &name : p.fnNames) h = hash(name.c_str(), name.size() + 1, h);
+    return h;
+  }
+
+#pragma mark - Expression Templates
+  inline size_t nativeIndex(const NativeFn fn) {
+    const auto &table = natives();
+    for (size_t i = 0; i < table.size(); ++i) if (table[i].fn == fn) return i;
+    return std::string::npos;
+  }
+
+  /**
+   Formulas written in C++: `3*var("x") + sin(var("y"))` builds an expression template, which either
+   compiles to the same program the string would (through `canonical()`, so constants get folded), or
+   binds to a program's slots and runs inline, with every operation known at compile time.
+   Functions are the natives, so they behave exactly like the string front end's.
+   */
+  namespace Dsl {
+    struct Expr {}; // Base of every expression type
+    template <typename T> struct IsExpr : std::is_base_of<Expr, T> {};
+    template <typename L, typename R> struct AreOperands {
+      static const bool value = (IsExpr<L>::value || IsExpr<R>::value) &&
+                                (IsExpr<L>::value || std::is_arithmetic<L>::value) && (IsExpr<R>::value || std::is_arithmetic<R>::value);
+    };
+
+    struct Lit : Expr {
+      Number value;
+      explicit Lit(const Number value) : value(value) {}
+      Number operator()(const Number*) const {return value;}
+      Node node() const {return {{Opcode::Const, 0, 0}, value, "", {}};}
+      void bind(const std::vector<std::string>&) {}
+    };
+
+    struct Var : Expr {
+      std::string name;
+      size_t slot = 0;
+      explicit Var(const std::string &name) : name(name) {}
+      Number operator()(const Number *slots) const {return slots[slot];}
+      Node node() const {return {{Opcode::Slot, 0, 0}, 0, name, {}};}
+      void bind(const std::vector<std::string> &vars) {
+        const auto it = std::find(std::begin(vars), std::end(vars), name);
+        if (it == std::end(vars)) throw EVAL_UNDEFINED_VAR(name);
+        slot = static_cast<size_t>(it - std::begin(vars));
+      }
+    };
+
+    template <Opcode Op, typename L, typename R> struct Binary : Expr {
+      L l; R r;
+      Binary(const L &l, const R &r) : l(l), r(r) {}
+      Number operator()(const Number *slots) const {return binary(Op, l(slots), r(slots));} // Op is constant, so the switch folds away.
+      Node node() const {return {{Op, 2, 0}, 0, "", {l.node(), r.node()}};}
+      void bind(const std::vector<std::string> &vars) {l.bind(vars); r.bind(vars);}
+    };
+
+    template <NativeFn F, typename A> struct Native1 : Expr {
+      A a;
+      explicit Native1(const A &a) : a(a) {}
+      Number operator()(const Number *slots) const {const Number args[] = {a(slots)}; return F(args);}
+      Node node() const {return {{Opcode::Native, 1, nativeIndex(F)}, 0, "", {a.node()}};}
+      void bind(const std::vector<std::string> &vars) {a.bind(vars);}
+    };
+
+    template <NativeFn F, typename A, typename B> struct Native2 : Expr {
+      A a; B b;
+      Native2(const A &a, const B &b) : a(a), b(b) {}
+      Number operator()(const Number *slots) const {const Number args[] = {a(slots), b(slots)}; return F(args);}
+      Node node() const {return {{Opcode::Native, 2, nativeIndex(F)}, 0, "", {a.node(), b.node()}};}
+      void bind(const std::vector<std::string> &vars) {a.bind(vars); b.bind(vars);}
+    };
+
+    // Numbers mix in as literals.
+    template <typename T> struct Of {typedef typename std::conditional<std::is_arithmetic<T>::value, Lit, T>::type type;};
+    template <typename T> inline typename std::enable_if<std::is_arithmetic<T>::value, Lit>::type wrap(const T v) {return Lit(static_cast<Number>(v));}
+    template <typename T> inline typename std::enable_if<IsExpr<T>::value, const T&>::type wrap(const T &e) {return e;}
+
+    inline Var var(const std::string &name) {return Var(name);}
+
+    EVAL_DEF_DSL_OP(+, Add) EVAL_DEF_DSL_OP(-, Sub) EVAL_DEF_DSL_OP(*, Mul) EVAL_DEF_DSL_OP(/, Div) EVAL_DEF_DSL_OP(%, Mod)
+    // `^` binds looser than `+` in C++, so powers are spelled out.
+    template <typename L, typename R, typename = typename std::enable_if<AreOperands<L, R>::value>::type>
+    inline Binary<Opcode::Pow, typename Of<L>::type, typename Of<R>::type> pow(const L &l, const R &r) {
+      return Binary<Opcode::Pow, typename Of<L>::type, typename Of<R>::type>(wrap(l), wrap(r));
+    }
+    // Same as the string front end's unary minus.
+    template <typename E, typename = typename std::enable_if<IsExpr<E>::value>::type> inline Binary<Opcode::Sub, Lit, E> operator-(const E &e) {
+      return Binary<Opcode::Sub, Lit, E>(Lit(0), e);
+    }
+
+    EVAL_DEF_DSL_FN(abs)
+    EVAL_DEF_DSL_FN(sqrt) EVAL_DEF_DSL_FN(cbrt)
+    EVAL_DEF_DSL_FN(sin) EVAL_DEF_DSL_FN(cos) EVAL_DEF_DSL_FN(tan)
+    EVAL_DEF_DSL_FN(asin) EVAL_DEF_DSL_FN(acos) EVAL_DEF_DSL_FN(atan)
+    EVAL_DEF_DSL_FN(floor) EVAL_DEF_DSL_FN(ceil) EVAL_DEF_DSL_FN(trunc) EVAL_DEF_DSL_FN(round)
+    template <typename L, typename R, typename = typename std::enable_if<AreOperands<L, R>::value>::type>
+    inline Native2<&Natives::hypot, typename Of<L>::type, typename Of<R>::type> hypot(const L &l, const R &r) {
+      return Native2<&Natives::hypot, typename Of<L>::type, typename Of<R>::type>(wrap(l), wrap(r));
+    }
+
+    /**
+     Compiles an expression, without any parsing.
+
+     @param[in] e
+     @returns the `canonical()` program
+     */
+    template <typename E> inline Program compile(const E &e) {
+      Program p;
+      emit(e.node(), p, p);
+      return canonical(p);
+    }
+
+    /**
+     Binds an expression's variables to slots, so it runs inline with `e(slots)`.
+
+     @param[in] e
+     @param[in] vars Slot names, e.g. a compiled program's `vars`
+     @returns bound expression
+     */
+    template <typename E> inline E bind(E e, const std::vector<std::string> &vars) {e.bind(vars); return e;}
+  }
+
+#pragma mark - Real-time Channel
+  // An index alone on a cache line, so threads writing neighbouring ones don't contend. Padded by hand
+  // rather than with alignas, which would pad whatever holds it.
+  struct CacheLineIndex {std::atomic<size_t> value{0}; char padding[64 - sizeof(std::atomic<size_t>)];};
+
+  /**
+   Lock-free single-producer/single-consumer ring buffer, holding up to N - 1 items.
+   Exactly one thread may push and exactly one (other) thread may peek/pop.
+   */
+  template <typename T, size_t N> class SpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two!");
+    CacheLineIndex head; // Next item to read; written by the consumer.
+    CacheLineIndex tail; // Next item to write; written by the producer.
+    T items[N];
+
+  public:
+    bool push(const T &item) {
+      const auto t = tail.value.load(std::memory_order_relaxed);
+      if (((t + 1) & (N - 1)) == head.value.load(std::memory_order_acquire)) return false; // Full
+      items[t] = item;
+      tail.value.store((t + 1) & (N - 1), std::memory_order_release);
+      return true;
+    }
+    T *peek() {
+      const auto h = head.value.load(std::memory_order_relaxed);
+      return h == tail.value.load(std::memory_order_acquire) ? nullptr : &items[h];
+    }
+    void pop() {head.value.store((head.value.load(std::memory_order_relaxed) + 1) & (N - 1), std::memory_order_release);}
+    bool pop(T &item) {
+      const auto front = peek();
+      if (!front) return false;
+      item = *front; pop();
+      return true;
+    }
+  };
+
+  /**
+   Feeds a real-time evaluator from another thread without either side blocking.
+   The producer (e.g. UI) thread owns `set()`, `swap()` and `collect()`; the consumer (real-time) thread owns
+   `apply()` and `run()`. Swapped-out programs are handed back to the producer to free, so the consumer never
+   touches the heap.
+   */
+  template <size_t N = 1024> class RealtimeChannel {
+    struct Update {size_t slot; Number value; const Program *program;}; // Swaps carry a program.
+    SpscQueue<Update, N> updates;
+    SpscQueue<const Program*, N> retired;
+    const Program *latest = nullptr; // Producer's view of the program
+    const Program *current = nullptr; // Consumer's program
+    Number slots[EVAL_MAX_SLOTS] = {};
+
+  public:
+    RealtimeChannel() = default;
+    RealtimeChannel(const RealtimeChannel&) = delete;
+    RealtimeChannel &operator=(const RealtimeChannel&) = delete;
+    ~RealtimeChannel() {
+      Update u;
+      while (updates.pop(u)) delete u.program;
+      collect();
+      delete current;
+    }
+
+    // Producer
+    /**
+     Queues a variable update for the program most recently swapped in.
+
+     @returns false if the queue is full or the variable isn't referenced
+     */
+    bool set(const std::string &name, const Number value) {
+      const auto slot = latest ? latest->slot(name) : std::string::npos;
+      return slot != std::string::npos && updates.push({slot, value, nullptr});
+    }
+    bool set(const size_t slot, const Number value) {return slot < EVAL_MAX_SLOTS && updates.push({slot, value, nullptr});}
+    /**
+     Queues a program to replace the current one. Its slots start at 0, so queue `set()`s after this.
+
+     @returns false if the queue is full
+     */
+    bool swap(Program p) {
+      if (!p.realtime()) throw EVAL_NOT_REALTIME_SAFE(p.fnNames.front());
+      if (p.vars.size() > EVAL_MAX_SLOTS) throw EVAL_TOO_MANY_SLOTS;
+      const auto program = new Program(std::move(p));
+      if (!updates.push({0, 0, program})) {delete program; return false;}
+      latest = program;
+      return true;
+    }
+    // Frees programs the consumer has swapped out.
+    void collect() {const Program *p; while (retired.pop(p)) delete p;}
+
+    // Consumer
+    /**
+     Applies pending updates; call at the start of each cycle.
+
+     @returns number of updates applied
+     */
+    size_t apply() {
+      size_t n = 0;
+      for (auto u = updates.peek(); u; u = updates.peek(), ++n) {
+        if (u->program) {
+          if (current && !retired.push(current)) break; // Producer hasn't collected; retry next cycle.
+          current = u->program;
+          std::fill(slots, slots + current->vars.size(), 0);
+        } else slots[u->slot] = u->value;
+        updates.pop();
+      }
+      return n;
+    }
+    // Runs the current program; NaN before the first swap.
+    Number run() const {return current ? _eval::run(*current, slots) : std::nan("");}
+  };
+
+#pragma mark - Memoization
+  /**
+   Bounded cache of a program's results, keyed by the exact bit patterns of its slot values (so 0 and -0 are
+   different inputs). Sets of 4 ways, evicting the least recently used. When fewer than `minHitRate` of a
+   window's lookups hit, the table turns itself off and `run()` just runs the program.
+   Only programs made of operators and natives can be memoized; user functions may not be pure.
+   Not thread-safe: use one per thread.
+   */
+  class MemoTable {
+    static const size_t WAYS = 4;
+    Program p;
+    size_t sets = 1, window;
+    double minHitRate;
+    std::vector<uint64_t> keys; // Slot bits per entry
+    std::vector<Number> results;
+    std::vector<uint64_t> used; // When each entry was last used; 0 if empty.
+    uint64_t clock = 0, windowHits = 0, windowLookups = 0;
+
+  public:
+    struct Stats {
+      uint64_t hits = 0, misses = 0, evictions = 0;
+      bool enabled = true;
+      char padding[sizeof(uint64_t) - sizeof(bool)];
+      double hitRate() const {return hits + misses ? static_cast<double>(hits)/static_cast<double>(hits + misses) : 0;}
+    };
+
+    /**
+     @param[in] p
+     @param[in] capacity Results kept, rounded up to a power of two
+     @param[in] minHitRate Turns off below this hit rate
+     @param[in] window Lookups the hit rate is measured over
+     */
+    explicit MemoTable(const Program &p, const size_t capacity = 4096, const double minHitRate = 0.05, const size_t window = 4096) : p(p), window(window), minHitRate(minHitRate) {
+      static_assert(sizeof(Number) == sizeof(uint64_t), "Slot values are keyed as 64-bit patterns.");
+      if (!p.realtime()) throw EVAL_NOT_PURE(p.fnNames.front());
+      if (p.vars.size() > EVAL_MAX_SLOTS) throw EVAL_TOO_MANY_SLOTS;
+      while (sets*WAYS < capacity) sets *= 2;
+      keys.resize(sets*WAYS*p.vars.size());
+      results.resize(sets*WAYS);
+      used.resize(sets*WAYS);
+    }
+
+    const Stats &stats() const {return s;}
+    // Empties the table and turns it back on.
+    void clear() {std::fill(std::begin(used), std::end(used), 0); s = Stats(); windowHits = windowLookups = 0;}
+
+    /**
+     @param[in] slots Variable values, indexed like `p.vars`
+     @returns the cached or computed result
+     */
+    Number run(const Number *slots) {
+      if (!s.enabled) return _eval::run(p, slots);
+      const auto n = p.vars.size(), size = n*sizeof(uint64_t);
+      uint64_t bits[EVAL_MAX_SLOTS];
+      if (n) std::memcpy(bits, slots, size); // Without variables slots may be null, and there's one key.
+      // FNV's low bits only see the low bits of each byte, and small doubles differ in their high bytes.
+      const auto set = static_cast<size_t>((hash(reinterpret_cast<const char*>(bits), size)*0x9E3779B97F4A7C15ull) >> 32) & (sets - 1);
+      auto victim = set*WAYS;
+      for (auto i = set*WAYS; i < (set + 1)*WAYS; ++i) {
+        if (used[i] && (!n || std::memcmp(keys.data() + i*n, bits, size) == 0)) {used[i] = ++clock; ++s.hits; ++windowHits; lookedUp(); return results[i];}
+        if (used[i] < used[victim]) victim = i;
+      }
+      ++s.misses;
+      if (used[victim]) ++s.evictions;
+      if (n) std::memcpy(keys.data() + victim*n, bits, size);
+      used[victim] = ++clock;
+      const auto result = results[victim] = _eval::run(p, slots);
+      lookedUp();
+      return result;
+    }
+
+  private:
+    Stats s;
+    void lookedUp() {
+      if (++windowLookups < window) return;
+      if (static_cast<double>(windowHits) < minHitRate*static_cast<double>(windowLookups)) s.enabled = false;
+      windowHits = windowLookups = 0;
+    }
+  };
+
+#pragma mark - Batch Evaluation
+  enum class FieldType : unsigned char {F64, F32, I64, I32, I16, I8, U64, U32, U16, U8};
+
+  // A column of any numeric type, possibly strided (e.g. one field of an array of records).
+  struct Column {
+    const char *base;
+    size_t stride;
+    FieldType type;
+    char padding[sizeof(size_t) - sizeof(FieldType)];
+
+    Column(const Number *values = nullptr) : base(reinterpret_cast<const char*>(values)), stride(sizeof(Number)), type(FieldType::F64) {}
+    Column(const void *base, const size_t stride, const FieldType type) : base(static_cast<const char*>(base)), stride(stride), type(type) {}
+    Column from(const size_t row) const {return Column(base + row*stride, stride, type);}
+  };
+
+  inline std::vector<Column> toColumns(const Number *const *columns, const size_t n) {return std::vector<Column>(columns, columns + n);}
+
+  // Rows this far ahead get prefetched when rows are scattered or each on its own cache line.
+  const size_t PREFETCH_ROWS = 8;
+
+  // Row numbers of a contiguous range, indexed like a selection vector.
+  struct RowRange {
+    size_t first;
+    size_t operator[](const size_t i) const {return first + i;}
+  };
+
+  template <typename T, typename Rows, typename D> inline void gather(const Column &c, const Rows &rows, const size_t n, const bool prefetch, D *dst) {
+    if (prefetch) for (size_t i = 0; i < n; ++i) {
+      if (i + PREFETCH_ROWS < n) EVAL_PREFETCH(c.base + rows[i + PREFETCH_ROWS]*c.stride);
+      T v; std::memcpy(&v, c.base + rows[i]*c.stride, sizeof(T)); dst[i] = static_cast<D>(v);
+    }
+    else for (size_t i = 0; i < n; ++i) {T v; std::memcpy(&v, c.base + rows[i]*c.stride, sizeof(T)); dst[i] = static_cast<D>(v);}
+  }
+
+  // Loads rows of a column, converting to D (numbers, or e.g. integer keys).
+  template <typename Rows, typename D> inline void load(const Column &c, const Rows &rows, const size_t n, const bool prefetch, D *dst) {
+    switch (c.type) {
+      case FieldType::F64: gather<double>(c, rows, n, prefetch, dst); break;
+      case FieldType::F32: gather<float>(c, rows, n, prefetch, dst); break;
+      case FieldType::I64: gather<int64_t>(c, rows, n, prefetch, dst); break;
+      case FieldType::I32: gather<int32_t>(c, rows, n, prefetch, dst); break;
+      case FieldType::I16: gather<int16_t>(c, rows, n, prefetch, dst); break;
+      case FieldType::I8: gather<int8_t>(c, rows, n, prefetch, dst); break;
+      case FieldType::U64: gather<uint64_t>(c, rows, n, prefetch, dst); break;
+      case FieldType::U32: gather<uint32_t>(c, rows, n, prefetch, dst); break;
+      case FieldType::U16: gather<uint16_t>(c, rows, n, prefetch, dst); break;
+      case FieldType::U8: gather<uint8_t>(c, rows, n, prefetch, dst); break;
+    }
+  }
+
+  // Loads rows [row, row + n) of a column as numbers.
+  inline void load(const Column &c, const size_t row, const size_t n, Number *dst) {
+    if (c.type == FieldType::F64 && c.stride == sizeof(Number)) std::memcpy(dst, c.base + row*c.stride, n*sizeof(Number));
+    else load(c, RowRange{row}, n, c.stride >= 64, dst);
+  }
+
+  // Loads the selected rows of a column as numbers.
+  inline void load(const Column &c, const uint32_t *rows, const size_t n, Number *dst) {load(c, rows, n, true, dst);}
+
+  // Field type of a numeric C++ type.
+  template <typename T> inline FieldType fieldType() {
+    static_assert(std::is_arithmetic<T>::value && sizeof(T) <= 8, "Only numeric fields of up to 8 bytes can be bound!");
+    if (std::is_floating_point<T>::value) return sizeof(T) == 4 ? FieldType::F32 : FieldType::F64;
+    switch (sizeof(T)) {
+      case 1: return std::is_signed<T>::value ? FieldType::I8 : FieldType::U8;
+      case 2: return std::is_signed<T>::value ? FieldType::I16 : FieldType::U16;
+      case 4: return std::is_signed<T>::value ? FieldType::I32 : FieldType::U32;
+      default: return std::is_signed<T>::value ? FieldType::I64 : FieldType::U64;
+    }
+  }
+
+  // Bytes a field of some type takes.
+  inline size_t fieldSize(const FieldType type) {
+    switch (type) {
+      case FieldType::F64: case FieldType::I64: case FieldType::U64: return 8;
+      case FieldType::F32: case FieldType::I32: case FieldType::U32: return 4;
+      case FieldType::I16: case FieldType::U16: return 2;
+      case FieldType::I8: case FieldType::U8: return 1;
+    }
+    return 8;
+  }
+
+  /**
+   Runs a program over one block of up to `B` rows, one instruction at a time, so each becomes a tight loop
+   the compiler can vectorize.
+
+   @param[in] p
+   @param[in] scratch `p.depth*B` numbers; a block per register (stack level or temporary)
+   @param[in] len Rows in the block
+   @param[in] LOAD Loads a slot's values for the block: `(slot, dst)`
+   @param[in] B Block size, e.g. `blockRows(p)`
+   @returns results (in scratch)
+   */
+  template <typename Load> inline const Number *runBlock(const Program &p, Number *scratch, const size_t len, const Load &LOAD, const size_t B) {
+    size_t top = 0;
+    const auto REG = [&](const size_t level) {return scratch + level*B;};
+    for (const auto &instr : p.code) {
+      switch (instr.op) {
+        case Opcode::Const: std::fill(REG(top), REG(top) + len, p.consts[instr.idx]); ++top; break;
+        case Opcode::Slot: LOAD(instr.idx, REG(top)); ++top; break;
+        case Opcode::Native:
+        case Opcode::Call: {
+          top -= instr.arity;
+          Number args[EVAL_MAX_DEPTH];
+          FnArgs strArgs;
+          for (size_t i = 0; i < len; ++i) {
+            for (size_t k = 0; k < instr.arity; ++k) args[k] = REG(top + k)[i];
+            if (instr.op == Opcode::Native) REG(top)[i] = natives()[instr.idx].fn(args);
+            else {
+              strArgs.clear();
+              for (size_t k = 0; k < instr.arity; ++k) strArgs.push_back(Type::toToken(args[k]));
+              REG(top)[i] = p.fns[instr.idx](strArgs);
+            }
+          }
+          ++top;
+          break;
+        }
+        case Opcode::Store: --top; std::copy(REG(top), REG(top) + len, REG(instr.idx)); break;
+        case Opcode::Load: std::copy(REG(instr.idx), REG(instr.idx) + len, REG(top)); ++top; break;
+        case Opcode::Add: case Opcode::Sub: case Opcode::Mul: case Opcode::Div: case Opcode::Pow: case Opcode::Mod: {
+          --top;
+          auto L = REG(top - 1);
+          const auto R = REG(top);
+          if (instr.op == Opcode::Add) for (size_t i = 0; i < len; ++i) L[i] += R[i];
+          else if (instr.op == Opcode::Sub) for (size_t i = 0; i < len; ++i) L[i] -= R[i];
+          else if (instr.op == Opcode::Mul) for (size_t i = 0; i < len; ++i) L[i] *= R[i];
+          else if (instr.op == Opcode::Div) for (size_t i = 0; i < len; ++i) L[i] /= R[i];
+          else for (size_t i = 0; i < len; ++i) L[i] = binary(instr.op, L[i], R[i]);
+          break;
+        }
+      }
+    }
+    return REG(0);
+  }
+
+  // Cache budget for a block's registers; tuned by `tuneBlocks()` or loaded with `loadBlockProfile()`.
+  inline std::atomic<size_t> &blockBudget() {static std::atomic<size_t> budget(EVAL_BLOCK_BUDGET); return budget;}
+
+  // Rows per block for a program, so a block of every register it uses fits the budget.
+  inline size_t blockRows(const Program &p, const size_t budget = blockBudget()) {
+    const auto rows = budget/(std::max<size_t>(1, p.depth)*sizeof(Number));
+    return std::min<size_t>(1 << 14, std::max<size_t>(16, rows/16*16));
+  }
+
+  /**
+   Runs a program over rows of columnar input, a block of rows at a time; see `blockRows()`.
+
+   @param[in] p
+   @param[in] columns Column per slot, indexed like `p.vars`
+   @param[in] n Number of rows
+   @param[out] out n results
+   @param[in] block Rows per block
+   */
+  inline void runBatch(const Program &p, const Column *columns, const size_t n, Number *out, const size_t block) {
+    std::vector<Number> scratch(p.depth*block);
+    for (size_t row = 0; row < n; row += block) {
+      const auto len = std::min(block, n - row);
+      const auto results = runBlock(p, scratch.data(), len, [&](const size_t slot, Number *dst) {load(columns[slot], row, len, dst);}, block);
+      std::copy(results, results + len, out + row);
+    }
+  }
+  inline void runBatch(const Program &p, const Column *columns, const size_t n, Number *out) {runBatch(p, columns, n, out, blockRows(p));}
+
+  /**
+   Runs a multi-statement program over columnar input, writing a column per output.
+
+   @param[in] p
+   @param[in] columns Column per slot
+   @param[in] n Number of rows
+   @param[out] outs Column per output, indexed like `p.outputs`
+   */
+  inline void runBatch(const Program &p, const Column *columns, const size_t n, Number *const *outs) {
+    const auto block = blockRows(p);
+    std::vector<Number> scratch(p.depth*block);
+    for (size_t row = 0; row < n; row += block) {
+      const auto len = std::min(block, n - row);
+      runBlock(p, scratch.data(), len, [&](const size_t slot, Number *dst) {load(columns[slot], row, len, dst);}, block);
+      for (size_t i = 0; i < p.outputs.size(); ++i) {
+        const auto reg = scratch.data() + p.outputRegister(i)*block;
+        std::copy(reg, reg + len, outs[i] + row);
+      }
+    }
+  }
+  inline void runBatch(const Program &p, const Number *const *columns, const size_t n, Number *out) {
+    runBatch(p, toColumns(columns, p.vars.size()).data(), n, out);
+  }
+
+  /**
+   Times a longish program over cache budgets from L1 to L2 sizes and keeps the fastest, for this machine.
+   Takes a few tenths of a second; save the result with `saveBlockProfile()` to skip it next time.
+
+   @returns budget chosen
+   */
+  inline size_t tuneBlocks() {
+    const auto p = compile(lex("(a*b + c)/(a - c*2) + sqrt(a*a + b*b)*(c + 1) - b/(a + 1) + hypot(a - b, c)"));
+    const size_t n = 1 << 18;
+    std::vector<Number> a(n), b(n), c(n), out(n);
+    for (size_t i = 0; i < n; ++i) {a[i] = static_cast<Number>(i % 1000); b[i] = 0.5; c[i] = static_cast<Number>(i % 7);}
+    std::vector<Column> cols(p.vars.size());
+    cols[p.slot("a")] = a.data(); cols[p.slot("b")] = b.data(); cols[p.slot("c")] = c.data();
+    auto best = blockBudget().load();
+    auto fastest = std::numeric_limits<double>::infinity();
+    for (size_t budget = 8 << 10; budget <= 1 << 20; budget *= 2) { // Other threads' batches keep the current budget meanwhile.
+      const auto block = blockRows(p, budget);
+      runBatch(p, cols.data(), n, out.data(), block);
+      const auto start = std::chrono::steady_clock::now();
+      for (int r = 0; r < 3; ++r) runBatch(p, cols.data(), n, out.data(), block);
+      const auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if (secs < fastest) {fastest = secs; best = budget;}
+    }
+    blockBudget().store(best);
+    return best;
+  }
+
+  // Saves the block budget (e.g. after `tuneBlocks()`) as a profile for later runs.
+  inline void saveBlockProfile(const std::string &path) {
+    const auto file = std::fopen(path.c_str(), "w");
+    if (!file) throw EVAL_SYSTEM_ERROR("fopen");
+    const auto ok = std::fprintf(file, "%llu\n", static_cast<unsigned long long>(blockBudget().load())) > 0;
+    if (std::fclose(file) != 0 || !ok) throw EVAL_SYSTEM_ERROR("fprintf");
+  }
+
+  // Loads a profile saved by `saveBlockProfile()`; false (keeping the budget) if there's no usable one.
+  inline bool loadBlockProfile(const std::string &path) {
+    const auto file = std::fopen(path.c_str(), "r");
+    if (!file) return false;
+    unsigned long long budget = 0;
+    const auto ok = std::fscanf(file, "%llu", &budget) == 1 && budget > 0;
+    std::fclose(file);
+    if (ok) blockBudget() = static_cast<size_t>(budget);
+    return ok;
+  }
+
+#pragma mark - Selections
+  enum class Output {
+    Compact, // The i-th selected row's result goes to out[i].
+    Scatter // Row r's result goes to out[r]; unselected rows are left alone.
+  };
+
+  inline size_t trailingZeros(const uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_ctzll(bits));
+#else
+    size_t n = 0;
+    for (auto b = bits; !(b & 1); b >>= 1) ++n;
+    return n;
+#endif
+  }
+
+  /**
+   Runs a program over selected rows only, gathering just their inputs instead of evaluating discarded rows
+   or materializing filtered copies of the columns.
+
+   @param[in] p
+   @param[in] columns Column per slot
+   @param[in] selection Row numbers (ascending reads best)
+   @param[in] n Number of selected rows
+   @param[out] out Results, compacted (n) or scattered (indexed by row)
+   @param[in] output
+   */
+  inline void runSelected(const Program &p, const Column *columns, const uint32_t *selection, const size_t n, Number *out,
+                          const Output output = Output::Compact) {
+    const auto block = blockRows(p);
+    std::vector<Number> scratch(p.depth*block);
+    for (size_t i = 0; i < n; i += block) {
+      const auto len = std::min(block, n - i);
+      const auto rows = selection + i;
+      const auto results = runBlock(p, scratch.data(), len, [&](const size_t slot, Number *dst) {load(columns[slot], rows, len, dst);}, block);
+      if (output == Output::Compact) std::copy(results, results + len, out + i);
+      else for (size_t k = 0; k < len; ++k) out[rows[k]] = results[k];
+    }
+  }
+
+  /**
+   Runs a program over the rows set in a bitmap (bit r % 64 of word r / 64 selects row r).
+
+   @param[in] p
+   @param[in] columns Column per slot
+   @param[in] bitmap
+   @param[in] rows Rows the bitmap covers
+   @param[out] out Results, compacted (one per set bit) or scattered (indexed by row)
+   @param[in] output
+   @returns number of selected rows
+   */
+  inline size_t runSelected(const Program &p, const Column *columns, const uint64_t *bitmap, const size_t rows, Number *out,
+                            const Output output = Output::Compact) {
+    const auto words = (rows + 63)/64;
+    const auto WORD = [&](const size_t w) {return w + 1 == words && rows % 64 ? bitmap[w] & ((1ull << (rows % 64)) - 1) : bitmap[w];};
+    std::vector<uint32_t> selection(blockRows(p));
+    size_t total = 0, w = 0;
+    auto bits = words ? WORD(0) : 0;
+    for (;;) {
+      size_t len = 0;
+      while (len < selection.size() && w < words) {
+        if (!bits) {if (++w < words) bits = WORD(w); continue;}
+        selection[len++] = static_cast<uint32_t>(w*64 + trailingZeros(bits));
+        bits &= bits - 1;
+      }
+      if (!len) return total;
+      runSelected(p, columns, selection.data(), len, output == Output::Compact ? out + total : out, output);
+      total += len;
+    }
+  }
+
+#pragma mark - Thread Pool
+  enum class Placement {
+    Any,
+    Pinned // Each worker stays on one CPU, consecutive workers on the same NUMA node where possible.
+  };
+
+  // Reads a sysfs list like "0-15,32-47"; empty if the file can't be read.
+  inline std::vector<size_t> readList(const std::string &path) {
+    std::vector<size_t> items;
+    const auto file = std::fopen(path.c_str(), "r");
+    if (!file) return items;
+    unsigned long first, last;
+    char sep = ',';
+    while (sep == ',' && std::fscanf(file, "%lu", &first) == 1) {
+      last = first;
+      if (std::fscanf(file, "%c", &sep) == 1 && sep == '-' && std::fscanf(file, "%lu%c", &last, &sep) < 1) break;
+      for (auto item = first; item <= last; ++item) items.push_back(item);
+    }
+    std::fclose(file);
+    return items;
+  }
+
+  /**
+   CPUs ordered by NUMA node, read from sysfs (so no libnuma); just 0..n-1 where that isn't available.
+   */
+  inline std::vector<size_t> cpusByNode() {
+    std::vector<size_t> cpus;
+#if defined(EVAL_POSIX) && defined(__linux__)
+    for (const auto node : readList("/sys/devices/system/node/online")) {
+      const auto list = readList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+      cpus.insert(std::end(cpus), std::begin(list), std::end(list));
+    }
+#endif
+    if (cpus.empty()) for (size_t cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) cpus.push_back(cpu);
+    return cpus;
+  }
+
+  // Pins the calling thread to a CPU; false if it couldn't be (or pinning isn't supported).
+  inline bool pinTo(const size_t cpu) {
+#if defined(EVAL_POSIX) && defined(__linux__)
+    if (cpu >= static_cast<size_t>(CPU_SETSIZE)) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+  }
+
+  /**
+   Fixed set of worker threads pulling tasks off a shared queue, or off their own for tasks sent to a
+   particular worker.
+   */
+  class ThreadPool {
+    typedef std::function<void()> Task;
+    std::vector<std::thread> workers;
+    std::queue<Task> tasks;
+    std::vector<std::queue<Task>> own;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<size_t> failedPins{0};
+    const Placement placement;
+    bool stopping = false;
+    uint32_t : 24; // Padding
+
+  public:
+    static const size_t ANY = std::string::npos;
+
+    explicit ThreadPool(const size_t n = std::max(1u, std::thread::hardware_concurrency()), const Placement placement = Placement::Any)
+    : own(n), placement(placement) {
+      const auto cpus = placement == Placement::Pinned ? cpusByNode() : std::vector<size_t>();
+      for (size_t i = 0; i < n; ++i) workers.emplace_back([this, i, cpus]() {
+        // Before allocating anything, so it's first touched on our node
+        if (!cpus.empty() && !pinTo(cpus[i % cpus.size()])) ++failedPins;
+        for (;;) {
+          Task task;
+          {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this, i]() {return stopping || !tasks.empty() || !own[i].empty();});
+            auto &queue = own[i].empty() ? tasks : own[i];
+            if (queue.empty()) return;
+            task = std::move(queue.front()); queue.pop();
+          }
+          task();
+        }
+      });
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool &operator=(const ThreadPool&) = delete;
+    ~ThreadPool() {
+      {std::lock_guard<std::mutex> lock(mutex); stopping = true;}
+      cv.notify_all();
+      for (auto &w : workers) w.join();
+    }
+
+    size_t size() const {return workers.size();}
+    bool pinned() const {return placement == Placement::Pinned;}
+    size_t unpinned() const {return failedPins;} // Workers of a pinned pool that couldn't be pinned (e.g. outside our cpuset), so far
+    /**
+     @param[in] f
+     @param[in] worker Worker to run it on, or `ANY`
+     */
+    template <typename F> std::future<void> submit(F f, const size_t worker = ANY) {
+      const auto task = std::make_shared<std::packaged_task<void()>>(f);
+      {std::lock_guard<std::mutex> lock(mutex); (worker == ANY ? tasks : own[worker % own.size()]).push([task]() {(*task)();});}
+      if (worker == ANY) cv.notify_one();
+      else cv.notify_all(); // The one we want might not be the one woken.
+      return task->get_future();
+    }
+  };
+
+  // Rows per task when a batch is split across a pool. A pinned pool runs the i-th chunk on worker i, so
+  // memory first touched chunk by chunk (see `firstTouch()`) is local to the worker that reads it.
+  inline size_t chunkRows(const ThreadPool &pool, const size_t n) {return std::max<size_t>(EVAL_BATCH_BLOCK*16, (n + pool.size() - 1)/pool.size());}
+
+  /**
+   Zeroes a buffer chunk by chunk on the workers that'll process each chunk, so on NUMA machines its pages
+   land on their nodes. Only helps memory that hasn't been touched yet, like fresh `mmap`s (or `PageBuffer`s).
+   */
+  inline void firstTouch(ThreadPool &pool, Number *data, const size_t n) {
+    const auto chunk = chunkRows(pool, n);
+    std::vector<std::future<void>> done;
+    for (size_t row = 0; row < n; row += chunk) done.push_back(pool.submit([=]() {std::fill(data + row, data + std::min(n, row + chunk), 0);}, row/chunk));
+    for (auto &d : done) d.get();
+  }
+
+  /**
+   Runs a program over columnar input, splitting the rows across a thread pool.
+   Rethrows the first error raised by a chunk.
+   */
+  inline void runBatch(ThreadPool &pool, const Program &p, const Column *columns, const size_t n, Number *out) {
+    const auto chunk = chunkRows(pool, n);
+    if (n <= chunk && !pool.pinned()) return runBatch(p, columns, n, out);
+    std::vector<std::future<void>> done;
+    for (size_t row = 0; row < n; row += chunk) done.push_back(pool.submit([&, row]() {
+      std::vector<Column> cols;
+      for (size_t c = 0; c < p.vars.size(); ++c) cols.push_back(columns[c].from(row));
+      runBatch(p, cols.data(), std::min(chunk, n - row), out + row); // Scratch is allocated here, on the worker's node.
+    }, pool.pinned() ? row/chunk : ThreadPool::ANY));
+    for (auto &d : done) d.wait(); // Chunks reference our arguments, so let every one finish before rethrowing.
+    for (auto &d : done) d.get();
+  }
+  inline void runBatch(ThreadPool &pool, const Program &p, const Number *const *columns, const size_t n, Number *out) {
+    runBatch(pool, p, toColumns(columns, p.vars.size()).data(), n, out);
+  }
+
+#pragma mark - Page Buffers
+  enum class Pages {
+    Normal,
+    Huge // 2 MB pages: hugetlbfs if the system has some reserved, else transparent huge pages, else normal.
+  };
+  enum class Backing {Normal, Transparent, HugeTlb};
+
+  // Huge page allocations so far, by what was obtained.
+  struct PageStats {std::atomic<size_t> hugeTlb, transparent, fallbacks;};
+  inline PageStats &pageStats() {static PageStats stats = {{0}, {0}, {0}}; return stats;}
+
+  const size_t HUGE_PAGE = 2 << 20;
+
+  /**
+   Numbers in memory straight from the OS (`mmap` where available) and left untouched, so each page lands
+   on the NUMA node of the thread that first writes it (see `firstTouch()`). Large buffers can ask for huge
+   pages to cut TLB misses.
+   */
+  class PageBuffer {
+    Number *base = nullptr;
+    size_t n = 0, bytes = 0;
+    Backing how = Backing::Normal;
+    uint32_t : 32; // Padding
+
+  public:
+    explicit PageBuffer(const size_t n, const Pages pages = Pages::Normal) : n(n), bytes(n*sizeof(Number)) {
+      if (!n) return;
+#ifdef EVAL_POSIX
+      void *mem = MAP_FAILED;
+      if (pages == Pages::Huge) {
+        bytes = (bytes + HUGE_PAGE - 1)/HUGE_PAGE*HUGE_PAGE;
+#ifdef MAP_HUGETLB
+        mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mem != MAP_FAILED) {how = Backing::HugeTlb; ++pageStats().hugeTlb;}
+#endif
+      }
+      if (mem == MAP_FAILED) mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (mem == MAP_FAILED) throw EVAL_SYSTEM_ERROR("mmap");
+      if (pages == Pages::Huge && how == Backing::Normal) {
+#ifdef MADV_HUGEPAGE
+        if (madvise(mem, bytes, MADV_HUGEPAGE) == 0) {how = Backing::Transparent; ++pageStats().transparent;}
+        else ++pageStats().fallbacks;
+#else
+        ++pageStats().fallbacks;
+#endif
+      }
+      base = static_cast<Number*>(mem);
+#else
+      if (pages == Pages::Huge) ++pageStats().fallbacks;
+      base = new Number[n]; // Not initialized, so not touched
+#endif
+    }
+    PageBuffer(const PageBuffer&) = delete;
+    PageBuffer &operator=(const PageBuffer&) = delete;
+    ~PageBuffer() {
+      if (!base) return;
+#ifdef EVAL_POSIX
+      munmap(base, bytes);
+#else
+      delete[] base;
+#endif
+    }
+
+    Number *data() {return base;}
+    const Number *data() const {return base;}
+    size_t size() const {return n;}
+    // What backs it; `Transparent` means the kernel was asked to, and will use huge pages where it can.
+    Backing backing() const {return how;}
+  };
+
+  inline Pages pagesFor(const size_t bytes) {
+    const size_t min = EVAL_HUGE_PAGE_MIN;
+    return min && bytes >= min ? Pages::Huge : Pages::Normal;
+  }
+
+#pragma mark - Single Flight
+  /**
+   Deduplicates concurrent work: while a key's computation is in flight, other callers asking for the same
+   key wait on it and share its result (or exception) instead of computing it again. Nothing is kept once
+   it lands; put a cache in front for that.
+   */
+  template <typename K, typename V> class SingleFlight {
+    std::mutex mutex;
+    std::map<K, std::shared_future<V>> inflight;
+
+  public:
+    std::atomic<size_t> shared = {0}; // Callers that waited on someone else's computation
+
+    template <typename F> V run(const K &key, F f) {
+      std::promise<V> promise;
+      std::shared_future<V> result;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = inflight.find(key);
+        if (it != std::end(inflight)) result = it->second;
+        else inflight[key] = promise.get_future().share();
+      }
+      if (result.valid()) {++shared; return result.get();}
+      try {promise.set_value(f());}
+      catch (...) {promise.set_exception(std::current_exception());}
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = inflight.find(key);
+        result = it->second;
+        inflight.erase(it);
+      }
+      return result.get();
+    }
+  };
+
+#pragma mark - Heterogeneous Batches
+  // One evaluation in a heterogeneous batch: a program and its slot values.
+  struct Item {const Program *program; const Number *slots;};
+
+  /**
+   Groups a batch's items by program: item indices per program, in order of first appearance.
+   */
+  inline std::vector<std::vector<uint32_t>> groupItems(const Item *items, const size_t n) {
+    std::map<const Program*, size_t> index;
+    std::vector<std::vector<uint32_t>> groups;
+    for (size_t i = 0; i < n; ++i) {
+      const auto it = index.insert(std::make_pair(items[i].program, groups.size())).first;
+      if (it->second == groups.size()) groups.emplace_back();
+      groups[it->second].push_back(static_cast<uint32_t>(i));
+    }
+    return groups;
+  }
+
+  // Runs one group on the batch path: transposes its items' slots into columns, then scatters results back.
+  inline void runGroup(const Item *items, const std::vector<uint32_t> &group, Number *out) {
+    const auto &p = *items[group.front()].program;
+    const auto m = group.size();
+    std::vector<Number> columns(p.vars.size()*m), results(m);
+    std::vector<Column> cols;
+    for (size_t s = 0; s < p.vars.size(); ++s) {
+      for (size_t j = 0; j < m; ++j) columns[s*m + j] = items[group[j]].slots[s];
+      cols.push_back(columns.data() + s*m);
+    }
+    runBatch(p, cols.data(), m, results.data());
+    for (size_t j = 0; j < m; ++j) out[group[j]] = results[j];
+  }
+
+  /**
+   Evaluates a batch whose items use different programs in one call, grouping items by program so each
+   group runs on the batch path, and writing results back in item order.
+
+   @param[in] items
+   @param[in] n
+   @param[out] out n results
+   */
+  inline void runHeterogeneous(const Item *items, const size_t n, Number *out) {
+    for (const auto &group : groupItems(items, n)) runGroup(items, group, out);
+  }
+
+  // Same as above, running groups in parallel.
+  inline void runHeterogeneous(ThreadPool &pool, const Item *items, const size_t n, Number *out) {
+    const auto groups = groupItems(items, n);
+    std::vector<std::future<void>> done;
+    for (const auto &group : groups) done.push_back(pool.submit([&]() {runGroup(items, group, out);}));
+    for (auto &d : done) d.wait();
+    for (auto &d : done) d.get();
+  }
+
+  /**
+   Lays out variable values in slot order.
+
+   @param[in] p
+   @param[in] vars
+   @returns slots
+   */
+  inline std::vector<Number> bindSlots(const Program &p, const VarMap &vars) {
+    std::vector<Number> slots;
+    for (const auto &name : p.vars) {
+      const auto it = vars.find(name);
+      if (it == std::end(vars)) throw EVAL_UNDEFINED_VAR(name);
+      slots.push_back(it->second);
+    }
+    return slots;
+  }
+
+#pragma mark - Serialization
+  struct ImageHeader {uint32_t magic; uint32_t natives; uint32_t code; uint32_t consts; uint32_t vars; uint32_t depth;};
+  struct ImageInstr {uint32_t op; uint32_t arity; uint32_t idx;};
+  const uint32_t IMAGE_MAGIC = 0x45564c31; // "EVL1"
+
+  /**
+   Flattens a program into a position-independent image: no pointers, natives referred to by index.
+   Programs calling user functions can't be flattened since those are arbitrary C++ closures.
+
+   @param[in] p
+   @returns image
+   */
+  inline std::string serialize(const Program &p) {
+    if (!p.realtime() || !p.outputs.empty()) throw EVAL_NOT_SERIALIZABLE;
+    const ImageHeader header = {IMAGE_MAGIC, static_cast<uint32_t>(natives().size()), static_cast<uint32_t>(p.code.size()),
+                                static_cast<uint32_t>(p.consts.size()), static_cast<uint32_t>(p.vars.size()), static_cast<uint32_t>(p.depth)};
+    std::string image(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto &instr : p.code) {
+      const ImageInstr packed = {static_cast<uint32_t>(instr.op), static_cast<uint32_t>(instr.arity), static_cast<uint32_t>(instr.idx)};
+      image.append(reinterpret_cast<const char*>(&packed), sizeof(packed));
+    }
+    image.append(reinterpret_cast<const char*>(p.consts.data()), p.consts.size()*sizeof(Number));
+    for (const auto &name : p.vars) image.append(name.c_str(), name.size() + 1);
+    return image;
+  }
+
+  /**
+   Rebuilds a program from an image made by `serialize()`.
+
+   @param[in] data
+   @param[in] size
+   @returns program
+   */
+  inline Program deserialize(const char *data, const size_t size) {
+    ImageHeader header;
+    if (size < sizeof(header)) throw EVAL_INVALID_IMAGE;
+    std::memcpy(&header, data, sizeof(header));
+    const auto fixed = sizeof(header) + header.code*sizeof(ImageInstr) + header.consts*sizeof(Number);
+    if (header.magic != IMAGE_MAGIC || header.natives != natives().size() || size < fixed || header.depth > EVAL_MAX_DEPTH) throw EVAL_INVALID_IMAGE;
+
+    Program p;
+    p.depth = header.depth;
+    auto at = data + sizeof(header);
+    for (uint32_t i = 0; i < header.code; ++i, at += sizeof(ImageInstr)) {
+      ImageInstr packed;
+      std::memcpy(&packed, at, sizeof(packed));
+      p.code.push_back({static_cast<Opcode>(packed.op), packed.arity, packed.idx});
+    }
+    p.consts.resize(header.consts);
+    std::memcpy(p.consts.data(), at, header.consts*sizeof(Number));
+    at += header.consts*sizeof(Number);
+    for (uint32_t i = 0; i < header.vars; ++i) {
+      const auto end = static_cast<const char*>(std::memchr(at, '\0', static_cast<size_t>(data + size - at)));
+      if (!end) throw EVAL_INVALID_IMAGE;
+      p.vars.emplace_back(at, end);
+      at = end + 1;
+    }
+    // Images may come from shared memory, so check the code stays inside its tables and stack before running it.
+    size_t top = 0;
+    std::vector<bool> stored(p.depth);
+    for (const auto &instr : p.code) {
+      size_t pops = 0;
+      auto valid = false;
+      switch (instr.op) {
+        case Opcode::Const: valid = !instr.arity && instr.idx < p.consts.size(); break;
+        case Opcode::Slot: valid = !instr.arity && instr.idx < p.vars.size(); break;
+        case Opcode::Load: valid = !instr.arity && instr.idx < p.depth && instr.idx >= top && stored[instr.idx]; break;
+        case Opcode::Add: case Opcode::Sub: case Opcode::Mul: case Opcode::Div: case Opcode::Pow: case Opcode::Mod:
+          pops = 2; valid = instr.arity == 2;
+          break;
+        case Opcode::Native: pops = instr.arity; valid = instr.idx < natives().size() && instr.arity == natives()[instr.idx].arity; break;
+        case Opcode::Store:
+          pops = 1; valid = !instr.arity && top && instr.idx < p.depth && instr.idx >= top - 1;
+          if (valid) stored[instr.idx] = true;
+          break;
+        case Opcode::Call: break; // User function calls can't be serialized.
+      }
+      if (!valid || top < pops) throw EVAL_INVALID_IMAGE;
+      top -= pops;
+      if (instr.op != Opcode::Store && ++top > p.depth) throw EVAL_INVALID_IMAGE;
+    }
+    if (top != 1) throw EVAL_INVALID_IMAGE;
+    return p;
+  }
+
+#ifdef EVAL_POSIX
+#pragma mark - Shared Cache
+  /**
+   Compiled programs shared across processes through a POSIX shared memory segment, so pre-forked (or
+   unrelated) workers only parse each expression once between them.
+
+   The segment is a header, an open-addressing table of entries and a bump-allocated data area holding
+   each entry's expression and program image. Lookups are lock-free; inserting claims an empty entry with
+   a CAS, writes the data, then publishes the entry with a release store. An entry mid-write reads as a
+   miss, so at worst two processes compile the same expression and both publish it.
+   */
+  class SharedCache {
+    enum State : uint32_t {Empty = 0, Writing = 1, Ready = 2};
+    struct Entry {std::atomic<uint32_t> state; uint32_t keySize; uint64_t hash; uint64_t offset; uint64_t size;};
+    struct Header {std::atomic<uint64_t> magic; uint64_t entries; uint64_t bytes; std::atomic<uint64_t> used;};
+    static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2, "Shared memory needs address-free atomics!");
+
+    std::string name;
+    size_t capacity, bytes, length; // Bounds come from what we mapped, never from the (shared, writable) header.
+    void *base = nullptr;
+    Header *header() const {return static_cast<Header*>(base);}
+    Entry *entries() const {return reinterpret_cast<Entry*>(static_cast<char*>(base) + sizeof(Header));}
+    char *data() const {return reinterpret_cast<char*>(entries() + capacity);}
+    SingleFlight<std::string, Program> flights;
+
+  public:
+    struct Stats {std::atomic<size_t> hits, misses, published;} stats = {{0}, {0}, {0}};
+
+    /**
+     Opens (creating if needed) the named segment. Every process must pass the same sizes.
+     Throws if the segment has other sizes, or its creator doesn't set it up within `EVAL_CACHE_WAIT_MS`.
+
+     @param[in] name Shared memory object name, e.g. "/eval-cache"
+     @param[in] entries Table capacity
+     @param[in] bytes Data area size
+     */
+    explicit SharedCache(const std::string &name, const size_t entries = 4096, const size_t bytes = 16 << 20)
+    : name(name), capacity(entries), bytes(bytes), length(sizeof(Header) + entries*sizeof(Entry) + bytes) {
+      auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+      const auto creator = fd >= 0;
+      if (!creator) fd = shm_open(name.c_str(), O_RDWR, 0600);
+      if (fd < 0) throw EVAL_SYSTEM_ERROR("shm_open");
+      if (creator && ftruncate(fd, static_cast<off_t>(length)) < 0) {close(fd); throw EVAL_SYSTEM_ERROR("ftruncate");}
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(EVAL_CACHE_WAIT_MS);
+      const auto waiting = [&]() {
+        if (std::chrono::steady_clock::now() < deadline) {std::this_thread::yield(); return true;}
+        return false;
+      };
+      struct stat st = {};
+      while (!creator && fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == 0 && waiting()) {}
+      if (!creator && (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != length)) {
+        close(fd);
+        if (st.st_size) throw EVAL_CACHE_MISMATCH(name);
+        throw EVAL_CACHE_TIMEOUT(name);
+      }
+      base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      if (base == MAP_FAILED) throw EVAL_SYSTEM_ERROR("mmap");
+      if (creator) { // The segment starts zeroed: every entry Empty, nothing used.
+        header()->entries = entries;
+        header()->bytes = bytes;
+        header()->magic.store(IMAGE_MAGIC, std::memory_order_release);
+        return;
+      }
+      while (header()->magic.load(std::memory_order_acquire) != IMAGE_MAGIC && waiting()) {}
+      const auto ready = header()->magic.load(std::memory_order_acquire) == IMAGE_MAGIC;
+      if (!ready || header()->entries != entries || header()->bytes != bytes) {
+        munmap(base, length);
+        if (ready) throw EVAL_CACHE_MISMATCH(name);
+        throw EVAL_CACHE_TIMEOUT(name);
+      }
+    }
+    SharedCache(const SharedCache&) = delete;
+    SharedCache &operator=(const SharedCache&) = delete;
+    ~SharedCache() {munmap(base, length);}
+
+    // Removes the segment's name; processes that have it mapped keep using it.
+    static void unlink(const std::string &name) {shm_unlink(name.c_str());}
+
+    /**
+     Looks up a published program.
+
+     @param[in] key Expression
+     @param[out] p
+     @returns whether it was found
+     */
+    bool find(const std::string &key, Program &p) const {
+      const auto h = hash(key.data(), key.size());
+      for (uint64_t i = 0; i < capacity; ++i) {
+        const auto &e = entries()[(h + i) % capacity];
+        const auto state = e.state.load(std::memory_order_acquire);
+        if (state == Empty) return false;
+        if (e.offset > bytes || e.size > bytes - e.offset || e.keySize > e.size) continue; // Corrupt
+        if (state == Ready && e.hash == h && e.keySize == key.size() && !key.compare(0, key.size(), data() + e.offset, e.keySize)) {
+          p = deserialize(data() + e.offset + e.keySize, e.size - e.keySize);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     Publishes a program for other processes.
+
+     @returns false if the table or data area is full
+     */
+    bool publish(const std::string &key, const Program &p) {
+      const auto image = serialize(p);
+      const auto h = hash(key.data(), key.size());
+      for (uint64_t i = 0; i < capacity; ++i) {
+        auto &e = entries()[(h + i) % capacity];
+        auto state = static_cast<uint32_t>(Empty);
+        if (!e.state.compare_exchange_strong(state, Writing, std::memory_order_acq_rel)) continue;
+        const uint64_t size = key.size() + image.size();
+        const auto offset = header()->used.fetch_add((size + 7) & ~7ull, std::memory_order_relaxed);
+        if (offset > bytes || size > bytes - offset) {e.state.store(Writing, std::memory_order_release); return false;} // Left Writing, so it's skipped.
+        std::memcpy(data() + offset, key.data(), key.size());
+        std::memcpy(data() + offset + key.size(), image.data(), image.size());
+        e.hash = h; e.keySize = static_cast<uint32_t>(key.size()); e.offset = offset; e.size = size;
+        e.state.store(Ready, std::memory_order_release);
+        return true;
+      }
+      return false;
+    }
+
+    /**
+     Gets the program for an expression, compiling and publishing its `canonical()` form on a miss. Threads that miss on the
+     same expression at the same time share one compilation (`shared()` counts them).
+
+     @param[in] str
+     @returns program
+     */
+    Program compile(const std::string &str) {
+      Program p;
+      if (find(str, p)) {++stats.hits; return p;}
+      ++stats.misses;
+      return flights.run(str, [&]() {
+        Program compiled;
+        if (find(str, compiled)) return compiled; // Published since we looked
+        compiled = canonical(_eval::compile(lex(str)));
+        if (publish(str, compiled)) ++stats.published;
+        return compiled;
+      });
+    }
+    size_t shared() const {return flights.shared;}
+  };
+#endif
+
+#pragma mark - Summaries
+  // Running count/sum/min/max of results; summaries of parts of a dataset merge into the summary of the whole.
+  struct Summary {
+    uint64_t count = 0;
+    Number sum = 0, min = std::numeric_limits<Number>::infinity(), max = -std::numeric_limits<Number>::infinity();
+
+    void add(const Number v) {++count; sum += v; min = std::min(min, v); max = std::max(max, v);}
+    void add(const Number *values, const size_t n) {
+      for (size_t i = 0; i < n; ++i) {sum += values[i]; min = std::min(min, values[i]); max = std::max(max, values[i]);}
+      count += n;
+    }
+    void merge(const Summary &s) {count += s.count; sum += s.sum; min = std::min(min, s.min); max = std::max(max, s.max);}
+    Number mean() const {return count ? sum/static_cast<Number>(count) : std::nan("");}
+  };
+
+#pragma mark - Group By
+  /**
+   Hash table from integer keys to summaries. Open addressing with linear probing over one flat array, so a
+   lookup usually touches a single cache line.
+   */
+  class SummaryTable {
+    struct Entry {int64_t key; bool used; char padding[sizeof(int64_t) - sizeof(bool)]; Summary summary;};
+    std::vector<Entry> entries;
+    size_t used = 0;
+
+    size_t home(const int64_t key) const { // Fibonacci hashing spreads sequential keys.
+      return static_cast<size_t>((static_cast<uint64_t>(key)*0x9E3779B97F4A7C15ull) >> 32) & (entries.size() - 1);
+    }
+
+  public:
+    explicit SummaryTable(const size_t capacity = 64) {
+      size_t n = 16;
+      while (n < capacity*2) n *= 2;
+      entries.resize(n);
+    }
+
+    size_t size() const {return used;}
+    Summary &operator[](const int64_t key) {
+      if ((used + 1)*2 > entries.size()) { // Keep at most half full.
+        SummaryTable bigger(entries.size());
+        bigger.merge(*this);
+        entries.swap(bigger.entries);
+      }
+      for (auto i = home(key);; i = (i + 1) & (entries.size() - 1)) {
+        auto &e = entries[i];
+        if (e.used && e.key == key) return e.summary;
+        if (!e.used) {e.used = true; e.key = key; ++used; return e.summary;}
+      }
+    }
+    void merge(const SummaryTable &t) {for (const auto &e : t.entries) if (e.used) (*this)[e.key].merge(e.summary);}
+    // Every key's summary, ordered by key.
+    std::vector<std::pair<int64_t, Summary>> sorted() const {
+      std::vector<std::pair<int64_t, Summary>> all;
+      for (const auto &e : entries) if (e.used) all.push_back(std::make_pair(e.key, e.summary));
+      std::sort(std::begin(all), std::end(all), [](const std::pair<int64_t, Summary> &a, const std::pair<int64_t, Summary> &b) {return a.first < b.first;});
+      return all;
+    }
+  };
+
+  /**
+   Evaluates a program per row and summarizes the results by key (count, sum, min, max and mean), in one pass.
+
+   @param[in] p
+   @param[in] columns Column per slot
+   @param[in] keys Key column (integer keys; other types are truncated)
+   @param[in] n Number of rows
+   @param[out] table Summaries are added to it
+   */
+  inline void aggregate(const Program &p, const Column *columns, const Column &keys, const size_t n, SummaryTable &table) {
+    const auto block = blockRows(p);
+    std::vector<Number> scratch(p.depth*block);
+    std::vector<int64_t> k(block);
+    for (size_t row = 0; row < n; row += block) {
+      const auto len = std::min(block, n - row);
+      const auto results = runBlock(p, scratch.data(), len, [&](const size_t slot, Number *dst) {load(columns[slot], row, len, dst);}, block);
+      load(keys, RowRange{row}, len, false, k.data());
+      for (size_t i = 0; i < len; ++i) table[k[i]].add(results[i]);
+    }
+  }
+
+  /**
+   Same as above, with each thread aggregating its own range of rows into its own table; the tables are
+   merged at the end.
+
+   @returns summaries ordered by key
+   */
+  inline std::vector<std::pair<int64_t, Summary>> aggregate(ThreadPool &pool, const Program &p, const Column *columns, const Column &keys, const size_t n) {
+    const auto parts = std::max<size_t>(1, std::min(pool.size(), n/EVAL_BATCH_BLOCK));
+    const auto per = (n + parts - 1)/parts;
+    std::vector<SummaryTable> tables(parts);
+    std::vector<std::future<void>> done;
+    for (size_t t = 0; t < parts; ++t) done.push_back(pool.submit([&, t]() {
+      std::vector<Column> cols;
+      for (size_t c = 0; c < p.vars.size(); ++c) cols.push_back(columns[c].from(t*per));
+      aggregate(p, cols.data(), keys.from(t*per), std::min(per, n - std::min(n, t*per)), tables[t]);
+    }));
+    for (auto &d : done) d.wait();
+    for (auto &d : done) d.get();
+    for (size_t t = 1; t < parts; ++t) tables[0].merge(tables[t]);
+    return tables[0].sorted();
+  }
+
+#pragma mark - Top K
+  struct Ranked {size_t row; Number score;};
+
+  // Higher scores first; ties go to the lower row, so results don't depend on how rows were split up.
+  inline bool ranksBefore(const Ranked &a, const Ranked &b) {return a.score > b.score || (a.score == b.score && a.row < b.row);}
+
+  /**
+   Evaluates a ranking program over rows, keeping the best k in a bounded heap (worst on top), so rows that
+   don't make the cut cost one comparison and nothing is materialized. NaN scores are skipped.
+
+   @param[in] p
+   @param[in] columns Column per slot
+   @param[in] n Number of rows
+   @param[in] k
+   @param[in,out] heap Bounded heap, e.g. empty
+   @param[in] firstRow Row number of the first row, for reporting
+   */
+  inline void topK(const Program &p, const Column *columns, const size_t n, const size_t k, std::vector<Ranked> &heap, const size_t firstRow = 0) {
+    if (!k) return;
+    const auto block = blockRows(p);
+    std::vector<Number> scratch(p.depth*block);
+    for (size_t row = 0; row < n; row += block) {
+      const auto len = std::min(block, n - row);
+      const auto results = runBlock(p, scratch.data(), len, [&](const size_t slot, Number *dst) {load(columns[slot], row, len, dst);}, block);
+      for (size_t i = 0; i < len; ++i) {
+        const Ranked r = {firstRow + row + i, results[i]};
+        if (std::isnan(r.score)) continue;
+        if (heap.size() < k) {heap.push_back(r); std::push_heap(std::begin(heap), std::end(heap), ranksBefore);}
+        else if (ranksBefore(r, heap.front())) {
+          std::pop_heap(std::begin(heap), std::end(heap), ranksBefore);
+          heap.back() = r;
+          std::push_heap(std::begin(heap), std::end(heap), ranksBefore);
+        }
+      }
+    }
+  }
+
+  /**
+   Finds the k rows a program scores highest (negate it for lowest).
+
+   @returns up to k rows and scores, best first
+   */
+  inline std::vector<Ranked> topK(const Program &p, const Column *columns, const size_t n, const size_t k) {
+    std::vector<Ranked> heap;
+    topK(p, columns, n, k, heap);
+    std::sort_heap(std::begin(heap), std::end(heap), ranksBefore);
+    return heap;
+  }
+
+  // Same as above, with a heap per thread, merged at the end.
+  inline std::vector<Ranked> topK(ThreadPool &pool, const Program &p, const Column *columns, const size_t n, const size_t k) {
+    const auto parts = std::max<size_t>(1, std::min(pool.size(), n/EVAL_BATCH_BLOCK));
+    const auto per = (n + parts - 1)/parts;
+    std::vector<std::vector<Ranked>> heaps(parts);
+    std::vector<std::future<void>> done;
+    for (size_t t = 0; t < parts; ++t) done.push_back(pool.submit([&, t]() {
+      std::vector<Column> cols;
+      for (size_t c = 0; c < p.vars.size(); ++c) cols.push_back(columns[c].from(t*per));
+      topK(p, cols.data(), std::min(per, n - std::min(n, t*per)), k, heaps[t], t*per);
+    }));
+    for (auto &d : done) d.wait();
+    for (auto &d : done) d.get();
+    std::vector<Ranked> best;
+    for (const auto &h : heaps) best.insert(std::end(best), std::begin(h), std::end(h));
+    const auto cut = std::min(k, best.size());
+    std::partial_sort(std::begin(best), std::begin(best) + static_cast<std::ptrdiff_t>(cut), std::end(best), ranksBefore);
+    best.resize(cut);
+    return best;
+  }
+
+#pragma mark - Live Editing
+  /**
+   A formula being edited live against a sample of rows. Each subtree's results over the sample are kept,
+   keyed by a structural hash, so after an edit only the subtrees that changed get evaluated again; the
+   unchanged ones (however they moved around, since programs are `canonical()`) are reused.
+   Only the last version's results are kept. An edit that doesn't compile throws and keeps them, so the
+   next keystroke can still reuse them. The text itself is lexed and compiled whole on every edit, which is
+   linear in its length; only evaluation is incremental.
+   */
+  class LiveFormula {
+    typedef std::shared_ptr<const std::vector<Number>> Results;
+    std::map<std::string, Column> sample;
+    size_t rows;
+    FnMap fns;
+    std::string str;
+    Program p;
+    struct Cached {const Node *node; Results results;}; // The node (in `tree`) confirms a hash match.
+    typedef std::multimap<uint64_t, Cached> Cache;
+    Cache cache, next;
+    std::unique_ptr<const Node> tree; // The last version's, which `cache` points into
+    std::map<const Node*, uint64_t> hashes; // Of the tree being evaluated
+    Results last;
+
+    static Results find(const Cache &c, const uint64_t h, const Node &n) {
+      const auto range = c.equal_range(h);
+      for (auto it = range.first; it != range.second; ++it) if (compare(*it->second.node, n) == 0) return it->second.results;
+      return nullptr;
+    }
+
+    uint64_t hashAll(const Node &n) {
+      std::vector<uint64_t> kids;
+      for (const auto &k : n.kids) kids.push_back(hashAll(k));
+      return hashes[&n] = structuralHash(n, kids.data());
+    }
+
+    // Keeps a reused subtree's own subtrees too, so later edits can still reuse them.
+    void carry(const Node &n) {
+      for (const auto &k : n.kids) {
+        const auto h = hashes.at(&k);
+        if (find(next, h, k)) continue;
+        if (const auto r = find(cache, h, k)) {next.insert(std::make_pair(h, Cached{&k, r})); carry(k);}
+      }
+    }
+
+    // Runs one node over the sample, with its kids' results as slots.
+    Results evaluate(const Node &n) {
+      const auto h = hashes.at(&n);
+      if (const auto r = find(next, h, n)) return r;
+      if (const auto r = find(cache, h, n)) {++stats.reused; next.insert(std::make_pair(h, Cached{&n, r})); carry(n); return r;}
+
+      Program step;
+      std::vector<Column> columns;
+      std::vector<Results> kids;
+      for (const auto &k : n.kids) {
+        kids.push_back(evaluate(k));
+        step.code.push_back({Opcode::Slot, 0, step.vars.size()});
+        step.vars.push_back(std::to_string(step.vars.size()));
+        columns.push_back(kids.back()->data());
+      }
+      auto instr = n.instr;
+      if (instr.op == Opcode::Const) {instr.idx = 0; step.consts.push_back(n.value);}
+      else if (instr.op == Opcode::Slot) {
+        const auto col = sample.find(n.name);
+        if (col == std::end(sample)) throw EVAL_UNDEFINED_VAR(n.name);
+        instr.idx = 0; step.vars.push_back(n.name); columns.push_back(col->second);
+      }
+      else if (instr.op == Opcode::Call) {instr.idx = 0; step.fnNames.push_back(n.name); step.fns.push_back(fns[n.name]);}
+      step.code.push_back(instr);
+      step.depth = std::max<size_t>(1, n.kids.size());
+
+      const auto out = std::make_shared<std::vector<Number>>(rows);
+      runBatch(step, columns.data(), rows, out->data());
+      ++stats.evaluated;
+      next.insert(std::make_pair(h, Cached{&n, out}));
+      return out;
+    }
+
+  public:
+    struct Stats {size_t reused = 0, evaluated = 0;} stats; // Subtrees, over every edit
+
+    /**
+     @param[in] sample Column per variable
+     @param[in] rows Rows in the sample
+     @param[in] fns Functions (optional)
+     */
+    LiveFormula(const std::map<std::string, Column> &sample, const size_t rows, const FnMap &fns = FnMap())
+    : sample(sample), rows(rows), fns(fns) {}
+
+    const std::string &text() const {return str;}
+    const Program &program() const {return p;}
+    // Results over the sample for the last text that compiled; empty before then.
+    const std::vector<Number> &results() const {static const std::vector<Number> none; return last ? *last : none;}
+
+    /**
+     Replaces `[begin, end)` of the text and re-evaluates.
+
+     @param[in] begin
+     @param[in] end
+     @param[in] replacement
+     @returns results over the sample
+     */
+    const std::vector<Number> &edit(const size_t begin, const size_t end, const std::string &replacement) {
+      if (begin > end || end > str.size()) throw EVAL_INVALID_EDIT;
+      str.replace(begin, end - begin, replacement);
+      auto compiled = canonical(_eval::compile(lex(str), fns));
+      std::unique_ptr<const Node> root(new Node(toTree(compiled)));
+      hashes.clear();
+      hashAll(*root);
+      next.clear();
+      try {last = evaluate(*root);} catch (...) {next.clear(); hashes.clear(); throw;} // They point into root.
+      cache.swap(next);
+      next.clear();
+      tree = std::move(root);
+      p = std::move(compiled);
+      return *last;
+    }
+    const std::vector<Number> &edit(const std::string &text) {return edit(0, str.size(), text);}
+  };
+
+#pragma mark - Column Files
+  /**
+   Binary, column-major input files: a header, NUL-terminated column names, then each column's rows as
+   native doubles. Being column-major means a range of rows of one column is a single contiguous read.
+   */
+  class ColumnFile {
+    struct Header {uint32_t magic; uint32_t columns; uint64_t rows; uint64_t dataOffset;};
+    static const uint32_t MAGIC = 0x45564331; // "EVC1"
+#ifdef EVAL_POSIX
+    int fd = -1;
+    int : 32; // Padding
+#else
+    std::FILE *file = nullptr;
+    mutable std::mutex mutex; // Reads seek, so they can't overlap.
+#endif
+    Header header;
+
+#ifdef EVAL_POSIX
+    void release() {close(fd);}
+#else
+    void release() {std::fclose(file);}
+#endif
+    bool readAt(void *buf, const size_t n, const uint64_t offset) const {
+#ifdef EVAL_POSIX
+      auto dst = static_cast<char*>(buf);
+      for (size_t at = 0; at < n;) {
+        const auto r = pread(fd, dst + at, n - at, static_cast<off_t>(offset + at));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        at += static_cast<size_t>(r);
+      }
+      return true;
+#else
+      std::lock_guard<std::mutex> lock(mutex);
+      return std::fseek(file, static_cast<long>(offset), SEEK_SET) == 0 && std::fread(buf, 1, n, file) == n;
+#endif
+    }
+    uint64_t size() const {
+#ifdef EVAL_POSIX
+      struct stat st;
+      return fstat(fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+#else
+      std::lock_guard<std::mutex> lock(mutex);
+      return std::fseek(file, 0, SEEK_END) == 0 ? static_cast<uint64_t>(std::max(0l, std::ftell(file))) : 0;
+#endif
+    }
+
+  public:
+    std::vector<std::string> names;
+
+    explicit ColumnFile(const std::string &path) {
+#ifdef EVAL_POSIX
+      fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0) throw EVAL_SYSTEM_ERROR("open");
+#else
+      file = std::fopen(path.c_str(), "rb");
+      if (!file) throw EVAL_SYSTEM_ERROR("fopen");
+#endif
+      // The header must describe names and data that fit in the file.
+      std::string text;
+      const auto bytes = size();
+      auto ok = readAt(&header, sizeof(header), 0) && header.magic == MAGIC && header.dataOffset >= sizeof(header) && header.dataOffset <= bytes;
+      ok = ok && header.columns <= header.dataOffset - sizeof(header) && (!header.rows || header.columns <= (bytes - header.dataOffset)/sizeof(Number)/header.rows);
+      if (ok) {text.resize(header.dataOffset - sizeof(header)); ok = readAt(&text[0], text.size(), sizeof(header));}
+      for (size_t at = 0; ok && names.size() < header.columns;) {
+        const auto end = text.find('\0', at);
+        if (end == std::string::npos) ok = false;
+        else {names.push_back(text.substr(at, end - at)); at = end + 1;}
+      }
+      if (!ok) {release(); throw EVAL_INVALID_COLUMN_FILE(path);}
+    }
+    ColumnFile(const ColumnFile&) = delete;
+    ColumnFile &operator=(const ColumnFile&) = delete;
+    ~ColumnFile() {release();}
+
+    size_t rows() const {return header.rows;}
+    size_t column(const std::string &name) const {
+      const auto it = std::find(std::begin(names), std::end(names), name);
+      if (it == std::end(names)) throw EVAL_UNDEFINED_VAR(name);
+      return static_cast<size_t>(it - std::begin(names));
+    }
+    /**
+     Reads rows [row, row + n) of a column. Safe to call from several threads at once.
+
+     @param[out] out n values
+     */
+    void read(const size_t column, const size_t row, const size_t n, Number *out) const {
+      if (!readAt(out, n*sizeof(Number), header.dataOffset + (column*header.rows + row)*sizeof(Number))) throw EVAL_SYSTEM_ERROR("read");
+    }
+
+    /**
+     Starts a column file, leaving it open for the caller to append each column's rows in order.
+
+     @param[in] path
+     @param[in] names Column names
+     @param[in] rows
+     @returns file
+     */
+    static std::FILE *create(const std::string &path, const std::vector<std::string> &names, const size_t rows) {
+      std::string text;
+      for (const auto &name : names) text.append(name.c_str(), name.size() + 1);
+      text.resize((sizeof(Header) + text.size() + 7)/8*8 - sizeof(Header), '\0'); // Keep the data aligned.
+      const Header h = {MAGIC, static_cast<uint32_t>(names.size()), rows, sizeof(Header) + text.size()};
+      const auto file = std::fopen(path.c_str(), "wb");
+      if (!file) throw EVAL_SYSTEM_ERROR("fopen");
+      if (std::fwrite(&h, sizeof(h), 1, file) != 1 || std::fwrite(text.data(), 1, text.size(), file) != text.size()) {
+        std::fclose(file); throw EVAL_SYSTEM_ERROR("fwrite");
+      }
+      return file;
+    }
+
+    /**
+     Writes a column file.
+
+     @param[in] path
+     @param[in] names Column names
+     @param[in] columns Column per name, each with `rows` values
+     @param[in] rows
+     */
+    static void write(const std::string &path, const std::vector<std::string> &names, const Number *const *columns, const size_t rows) {
+      const auto file = create(path, names, rows);
+      auto ok = true;
+      for (size_t c = 0; c < names.size() && ok; ++c) ok = std::fwrite(columns[c], sizeof(Number), rows, file) == rows;
+      if (std::fclose(file) != 0 || !ok) throw EVAL_SYSTEM_ERROR("fwrite");
+    }
+  };
+
+#pragma mark - Out-of-core Evaluation
+  /**
+   Evaluates a program over a column file of any size into a single-column ("result") column file, holding
+   only a couple of blocks in memory. A dedicated I/O thread reads the next block while the current one is
+   evaluated and written out.
+
+   @param[in] p
+   @param[in] in Column file; columns are matched to variables by name
+   @param[in] out
+   @param[in] budget Bytes of input/output buffers to use
+   @returns summary of all results
+   */
+  inline Summary runFile(const Program &p, const std::string &in, const std::string &out, const size_t budget = 64 << 20) {
+    const ColumnFile file(in);
+    std::vector<size_t> columns;
+    for (const auto &name : p.vars) columns.push_back(file.column(name));
+    const auto rows = file.rows();
+    // Two input blocks (current and prefetching) plus an output block.
+    const auto block = std::max<size_t>(EVAL_BATCH_BLOCK, budget/((2*columns.size() + 1)*sizeof(Number)));
+
+    struct Buffer {std::unique_ptr<PageBuffer> data; size_t row, n; bool full; char padding[sizeof(size_t) - sizeof(bool)];};
+    Buffer buffers[2];
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::exception_ptr error;
+    auto stopping = false;
+    for (auto &b : buffers) {b.data.reset(new PageBuffer(columns.size()*block, pagesFor(columns.size()*block*sizeof(Number)))); b.full = false;}
+    Summary summary;
+    PageBuffer results(std::min(block, rows), pagesFor(std::min(block, rows)*sizeof(Number)));
+    std::vector<const Number*> cols(columns.size());
+    // Everything that can throw is set up before the reader starts, so it's always joined.
+    auto dst = ColumnFile::create(out, {"result"}, rows);
+
+    std::thread io([&]() {
+      size_t k = 0;
+      for (size_t row = 0; row < rows; row += block, ++k) {
+        auto &b = buffers[k % 2];
+        {std::unique_lock<std::mutex> lock(mutex); cv.wait(lock, [&]() {return !b.full || stopping;}); if (stopping) return;}
+        b.row = row; b.n = std::min(block, rows - row);
+        try {for (size_t c = 0; c < columns.size(); ++c) file.read(columns[c], row, b.n, b.data->data() + c*block);}
+        catch (...) {std::lock_guard<std::mutex> lock(mutex); error = std::current_exception(); b.full = true; cv.notify_all(); return;}
+        {std::lock_guard<std::mutex> lock(mutex); b.full = true;}
+        cv.notify_all();
+      }
+    });
+
+    try {
+      size_t k = 0;
+      for (size_t row = 0; row < rows; row += block, ++k) {
+        auto &b = buffers[k % 2];
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cv.wait(lock, [&]() {return b.full;});
+          if (error) std::rethrow_exception(error);
+        }
+        for (size_t c = 0; c < columns.size(); ++c) cols[c] = b.data->data() + c*block;
+        runBatch(p, cols.data(), b.n, results.data());
+        summary.add(results.data(), b.n);
+        if (std::fwrite(results.data(), sizeof(Number), b.n, dst) != b.n) throw EVAL_SYSTEM_ERROR("fwrite");
+        {std::lock_guard<std::mutex> lock(mutex); b.full = false;}
+        cv.notify_all();
+      }
+    } catch (...) {
+      {std::lock_guard<std::mutex> lock(mutex); stopping = true;}
+      cv.notify_all();
+      io.join();
+      std::fclose(dst);
+      throw;
+    }
+    io.join();
+    if (std::fclose(dst) != 0) throw EVAL_SYSTEM_ERROR("fclose");
+    return summary;
+  }
+
+  /**
+   Layout of fixed-width binary records: each field's offset and type within a record of `stride` bytes.
+   */
+  struct RecordLayout {
+    struct Field {size_t offset; FieldType type; char padding[sizeof(size_t) - sizeof(FieldType)];};
+    size_t stride;
+    std::map<std::string, Field> fields;
+
+    explicit RecordLayout(const size_t stride) : stride(stride) {if (!stride) throw EVAL_INVALID_LAYOUT("records have no size");}
+    RecordLayout &field(const std::string &name, const size_t offset, const FieldType type) {
+      if (offset > stride || fieldSize(type) > stride - offset) throw EVAL_INVALID_LAYOUT("field \"" + name + "\" doesn't fit in a record");
+      fields[name] = {offset, type, {}};
+      return *this;
+    }
+
+    /**
+     Binds a program's variables to fields of records starting at `base`.
+
+     @param[in] p
+     @param[in] base First record
+     @returns column per slot
+     */
+    std::vector<Column> bind(const Program &p, const void *base) const {
+      std::vector<Column> columns;
+      for (const auto &name : p.vars) {
+        const auto it = fields.find(name);
+        if (it == std::end(fields)) throw EVAL_UNDEFINED_FIELD(name);
+        columns.push_back(Column(static_cast<const char*>(base) + it->second.offset, stride, it->second.type));
+      }
+      return columns;
+    }
+  };
+
+  /**
+   Binds variables to members of a struct, so programs run straight over arrays of it (no transposing
+   into columns, no `VarMap` per element).
+   */
+  template <typename T> class StructBinding {
+    RecordLayout layout = RecordLayout(sizeof(T));
+
+  public:
+    template <typename M> StructBinding &bind(const std::string &name, M T::*member) {
+      typename std::aligned_storage<sizeof(T), alignof(T)>::type storage; // Only used for its addresses.
+      const auto object = reinterpret_cast<const T*>(&storage);
+      const auto offset = reinterpret_cast<const char*>(&(object->*member)) - reinterpret_cast<const char*>(object);
+      layout.field(name, static_cast<size_t>(offset), fieldType<M>());
+      return *this;
+    }
+
+    /**
+     Runs a program over an array of structs.
+
+     @param[in] p
+     @param[in] items
+     @param[in] n
+     @param[out] out n results
+     */
+    void run(const Program &p, const T *items, const size_t n, Number *out) const {runBatch(p, layout.bind(p, items).data(), n, out);}
+    void run(ThreadPool &pool, const Program &p, const T *items, const size_t n, Number *out) const {
+      runBatch(pool, p, layout.bind(p, items).data(), n, out);
+    }
+  };
+
+#pragma mark - NDJSON
+  /**
+   Reads newline-delimited JSON objects, pulling out only the top-level numeric fields a program references,
+   and evaluates them a block of records at a time. There's no DOM: each record is scanned once, with
+   `memchr` (vectorized by the C library) finding quotes and newlines, and everything else skipped over.
+   Missing or non-numeric fields read as NaN.
+   */
+  class NdjsonReader {
+    const Program &p;
+    const size_t block;
+    std::vector<Number> columns; // Column per slot, `block` rows each
+    std::vector<Number> results;
+    size_t rows = 0;
+
+    static const char *skipSpace(const char *c, const char *end) {
+      while (c < end && (*c == ' ' || *c == '\t' || *c == '\r')) ++c;
+      return c;
+    }
+    // Returns the closing quote of a string whose contents start at `c`.
+    static const char *endOfString(const char *c, const char *end) {
+      for (;;) {
+        const auto quote = static_cast<const char*>(std::memchr(c, '"', static_cast<size_t>(end - c)));
+        if (!quote) return end;
+        auto escapes = quote;
+        while (escapes > c && escapes[-1] == '\\') --escapes;
+        if ((quote - escapes) % 2 == 0) return quote;
+        c = quote + 1;
+      }
+    }
+    static const char *skipValue(const char *c, const char *end) {
+      if (c < end && *c == '"') return std::min(end, endOfString(c + 1, end) + 1);
+      for (int depth = 0; c < end; ++c) {
+        if (*c == '"') c = endOfString(c + 1, end);
+        else if (*c == '{' || *c == '[') ++depth;
+        else if (*c == '}' || *c == ']') {if (depth-- == 0) return c;}
+        else if (*c == ',' && depth == 0) return c;
+      }
+      return end;
+    }
+
+    void flush(const std::function<void(const Number*, size_t)> &sink) {
+      if (!rows) return;
+      std::vector<Column> cols;
+      for (size_t c = 0; c < p.vars.size(); ++c) cols.push_back(columns.data() + c*block);
+      runBatch(p, cols.data(), rows, results.data());
+      sink(results.data(), rows);
+      rows = 0;
+    }
+
+  public:
+    NdjsonReader(const Program &p, const size_t block = 4096) : p(p), block(block), columns(p.vars.size()*block), results(block) {}
+
+    /**
+     Extracts a record's referenced fields.
+
+     @param[in] begin Record (one line)
+     @param[in] end
+     @param[out] values Slot values, `stride` apart
+     @param[in] stride
+     @returns whether the record is an object
+     */
+    bool extract(const char *begin, const char *end, Number *values, const size_t stride = 1) const {
+      for (size_t s = 0; s < p.vars.size(); ++s) values[s*stride] = std::nan("");
+      auto c = skipSpace(begin, end);
+      if (c == end || *c != '{') return false;
+      for (c = skipSpace(c + 1, end); c < end && *c == '"'; c = skipSpace(c, end)) {
+        const auto key = c + 1, keyEnd = endOfString(key, end);
+        c = skipSpace(keyEnd + 1, end);
+        if (c >= end || *c != ':') return false;
+        c = skipSpace(c + 1, end);
+        const auto keySize = static_cast<size_t>(keyEnd - key);
+        auto slot = std::string::npos;
+        for (size_t s = 0; s < p.vars.size() && slot == std::string::npos; ++s) {
+          if (p.vars[s].size() == keySize && !std::memcmp(p.vars[s].data(), key, keySize)) slot = s;
+        }
+        if (slot != std::string::npos && c < end && (*c == '-' || (*c >= '0' && *c <= '9'))) {
+          c = Parse::number(c, end, values[slot*stride]);
+        }
+        c = skipSpace(skipValue(c, end), end);
+        if (c < end && *c == ',') c = skipSpace(c + 1, end);
+      }
+      return true;
+    }
+
+    /**
+     Evaluates every record in a stream.
+
+     @param[in] in
+     @param[in] sink Called with each block of results, in order
+     @returns number of records
+     */
+    size_t run(std::istream &in, const std::function<void(const Number*, size_t)> &sink) {
+      std::vector<char> buf(1 << 20);
+      size_t carried = 0, records = 0;
+      for (auto eof = false; !eof;) {
+        if (carried + 1 >= buf.size()) buf.resize(buf.size()*2); // A record longer than the buffer (less room for a newline)
+        in.read(buf.data() + carried, static_cast<std::streamsize>(buf.size() - carried - 1)); // Room for a final newline
+        auto size = carried + static_cast<size_t>(in.gcount());
+        eof = !in;
+        if (eof && size && buf[size - 1] != '\n') buf[size++] = '\n';
+        auto line = buf.data();
+        const auto end = buf.data() + size;
+        for (const char *nl; (nl = static_cast<const char*>(std::memchr(line, '\n', static_cast<size_t>(end - line)))); line = const_cast<char*>(nl) + 1) {
+          if (skipSpace(line, nl) == nl) continue; // Blank line
+          extract(line, nl, columns.data() + rows, block);
+          ++records;
+          if (++rows == block) flush(sink);
+        }
+        carried = static_cast<size_t>(end - line);
+        std::memmove(buf.data(), line, carried);
+      }
+      flush(sink);
+      return records;
+    }
+  };
+
+#ifdef EVAL_POSIX
+#pragma mark - Record Files
+  /**
+   A file of fixed-width binary records, memory-mapped so programs read fields in place: no parsing and no
+   copies, and only the cache lines (and pages) holding referenced fields get touched.
+   */
+  class RecordFile {
+    void *base = MAP_FAILED;
+    size_t length = 0;
+
+  public:
+    const RecordLayout layout;
+    const size_t offset; // Bytes before the first record (e.g. a file header)
+
+    RecordFile(const std::string &path, const RecordLayout &layout, const size_t offset = 0) : layout(layout), offset(offset) {
+      const auto fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0) throw EVAL_SYSTEM_ERROR("open");
+      struct stat st;
+      if (fstat(fd, &st) < 0) {close(fd); throw EVAL_SYSTEM_ERROR("fstat");}
+      length = static_cast<size_t>(st.st_size);
+      if (length) base = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (length && base == MAP_FAILED) throw EVAL_SYSTEM_ERROR("mmap");
+      if (length) madvise(base, length, MADV_SEQUENTIAL);
+    }
+    RecordFile(const RecordFile&) = delete;
+    RecordFile &operator=(const RecordFile&) = delete;
+    ~RecordFile() {if (length) munmap(base, length);}
+
+    size_t records() const {return length > offset ? (length - offset)/layout.stride : 0;}
+    const char *data() const {return static_cast<const char*>(base) + offset;}
+    std::vector<Column> bind(const Program &p) const {return layout.bind(p, data());}
+
+    /**
+     Runs a program over every record.
+
+     @param[out] out `records()` results
+     */
+    void run(const Program &p, Number *out) const {runBatch(p, bind(p).data(), records(), out);}
+  };
+
+#pragma mark - Sharded Evaluation
+  // Rows a shard reads, evaluates and sends at a time.
+  const size_t SHARD_BLOCK = 64*1024;
+
+  inline bool writeAll(const int fd, const void *buf, size_t n) {
+    auto p = static_cast<const char*>(buf);
+    while (n) {
+      const auto w = ::write(fd, p, n);
+      if (w < 0 && errno == EINTR) continue;
+      if (w <= 0) return false;
+      p += w; n -= static_cast<size_t>(w);
+    }
+    return true;
+  }
+
+  /**
+   Evaluates rows [begin, end) of a column file, streaming results (unless `summarize`) and then a `Summary`
+   to a file descriptor. This is everything a worker does, so the descriptor can be a pipe or a socket.
+
+   @param[in] p
+   @param[in] file
+   @param[in] columns File column per slot
+   @param[in] begin
+   @param[in] end
+   @param[in] fd
+   @param[in] summarize Only send the summary
+   @returns whether everything was sent
+   */
+  inline bool runShard(const Program &p, const ColumnFile &file, const std::vector<size_t> &columns,
+                       const size_t begin, const size_t end, const int fd, const bool summarize) {
+    std::vector<Number> in(columns.size()*SHARD_BLOCK), out(SHARD_BLOCK);
+    std::vector<const Number*> cols;
+    for (size_t c = 0; c < columns.size(); ++c) cols.push_back(in.data() + c*SHARD_BLOCK);
+    Summary summary;
+    for (size_t row = begin; row < end; row += SHARD_BLOCK) {
+      const auto n = std::min(SHARD_BLOCK, end - row);
+      for (size_t c = 0; c < columns.size(); ++c) file.read(columns[c], row, n, in.data() + c*SHARD_BLOCK);
+      runBatch(p, cols.data(), n, out.data());
+      summary.add(out.data(), n);
+      if (!summarize && !writeAll(fd, out.data(), n*sizeof(Number))) return false;
+    }
+    return writeAll(fd, &summary, sizeof(summary));
+  }
+
+  /**
+   Evaluates a program over a column file in worker processes, each taking a contiguous range of rows and
+   sending back results over a pipe, which are merged in row order. Workers are forked, so user functions
+   work, and a crash in one only fails that shard.
+
+   @param[in] p
+   @param[in] path Column file; columns are matched to variables by name
+   @param[in] workers At least 1 (0 is taken as 1)
+   @param[out] out Results in row order (optional; without it only the summary is sent back)
+   @returns summary of all results
+   */
+  inline Summary runSharded(const Program &p, const std::string &path, const size_t workers, std::vector<Number> *out = nullptr) {
+    struct Shard {pid_t pid; int fd; size_t begin, end, received; Summary summary;};
+    const ColumnFile file(path);
+    std::vector<size_t> columns;
+    for (const auto &name : p.vars) columns.push_back(file.column(name));
+    const auto rows = file.rows();
+    if (out) out->resize(rows);
+
+    std::vector<Shard> shards;
+    // On failure, no worker is left running or unreaped. (Errors are made first, while errno is theirs.)
+    const auto ABANDON = [&]() {
+      for (auto &s : shards) {
+        if (s.fd >= 0) close(s.fd);
+        kill(s.pid, SIGKILL);
+        while (waitpid(s.pid, nullptr, 0) < 0 && errno == EINTR);
+      }
+    };
+    const auto count = std::max<size_t>(workers, 1);
+    const auto per = (rows + count - 1)/count;
+    for (size_t begin = 0; begin < rows || shards.empty(); begin += per) {
+      int fds[2];
+      if (pipe(fds) < 0) {const auto error = EVAL_SYSTEM_ERROR("pipe"); ABANDON(); throw error;}
+      const Shard shard = {fork(), fds[0], begin, std::min(rows, begin + per), 0, Summary()};
+      if (shard.pid == 0) {
+        close(fds[0]);
+        auto ok = false;
+        try {ok = runShard(p, file, columns, shard.begin, shard.end, fds[1], !out);} catch (...) {}
+        _exit(ok ? 0 : 1);
+      }
+      close(fds[1]);
+      if (shard.pid < 0) {const auto error = EVAL_SYSTEM_ERROR("fork"); close(fds[0]); ABANDON(); throw error;}
+      shards.push_back(shard);
+      if (!per) break;
+    }
+
+    // Drain every pipe as data arrives, so no worker blocks on a full pipe while we wait on another.
+    std::vector<pollfd> polls;
+    for (const auto &s : shards) polls.push_back({s.fd, POLLIN, 0});
+    for (size_t open = shards.size(); open;) {
+      if (poll(polls.data(), polls.size(), -1) < 0) {
+        if (errno == EINTR) continue;
+        const auto error = EVAL_SYSTEM_ERROR("poll");
+        ABANDON();
+        throw error;
+      }
+      for (size_t i = 0; i < shards.size(); ++i) {
+        if (polls[i].fd < 0 || !polls[i].revents) continue;
+        auto &s = shards[i];
+        const auto results = out ? (s.end - s.begin)*sizeof(Number) : 0;
+        const auto dst = s.received < results ? reinterpret_cast<char*>(out->data() + s.begin) + s.received
+                                              : reinterpret_cast<char*>(&s.summary) + (s.received - results);
+        const auto want = s.received < results ? results - s.received : results + sizeof(Summary) - s.received;
+        const auto r = want ? ::read(s.fd, dst, want) : 0;
+        if (r < 0 && errno == EINTR) continue;
+        if (r > 0) {s.received += static_cast<size_t>(r); continue;}
+        close(s.fd); s.fd = polls[i].fd = -1; --open;
+      }
+    }
+
+    std::vector<int> statuses(shards.size()); // Every worker is reaped before any failure is reported.
+    for (size_t i = 0; i < shards.size(); ++i) while (waitpid(shards[i].pid, &statuses[i], 0) < 0 && errno == EINTR);
+    Summary summary;
+    for (size_t i = 0; i < shards.size(); ++i) {
+      const auto expected = (out ? (shards[i].end - shards[i].begin)*sizeof(Number) : 0) + sizeof(Summary);
+      if (!WIFEXITED(statuses[i]) || WEXITSTATUS(statuses[i]) != 0 || shards[i].received != expected) throw EVAL_SHARD_FAILED(i);
+      summary.merge(shards[i].summary);
+    }
+    return summary;
+  }
+#endif
+}
+
+/**
+ Evaluates a string by tokenizing, creating an RPN stack, and evaluating it.
+
+ @param[in] str
+ @param[in] vars Custom in-place variables (optional)
+ @param[in] fns Functions (optional)
+ @returns result
+ */
+inline _eval::Number eval(std::string str,
+                          _eval::VarMap vars = _eval::VarMap(),
+                          _eval::FnMap fns = _eval::FnMap()) {
+  str.erase(std::remove(std::begin(str), std::end(str), ' '), std::end(str)); // Remove whitespace.
+  if (str.empty()) return 0; // "null" evaluates to 0.
+  _eval::bindBuiltins(vars, fns);
+  auto q = _eval::read(_eval::rewriteExpression(str), vars, fns);
+  return _eval::queue(q);
+}
+
+/**
+ Compiles a string once, so it can be run many times without re-parsing. Statements ("t = a*b; out = t + 1")
+ compile to a program with several outputs; see `_eval::compileStatements()`.
+
+ @param[in] str
+ @param[in] fns Functions (optional)
+ @param[in] mode `Mode::Realtime` rejects functions that aren't real-time safe (optional)
+ @returns program
+ */
+inline _eval::Program compile(const std::string &str,
+                              _eval::FnMap fns = _eval::FnMap(),
+                              const _eval::Mode mode = _eval::Mode::Default) {
+  if (str.find('=') != std::string::npos) return _eval::compileStatements(str, _eval::Definitions(), fns, mode);
+  return _eval::compile(_eval::lex(str), fns, mode);
+}
+
+/**
+ Compiles a string that calls functions defined with `_eval::define()`; the calls get inlined.
+
+ @param[in] str
+ @param[in] defs
+ @param[in] fns Functions (optional)
+ @param[in] mode (optional)
+ @returns program
+ */
+inline _eval::Program compile(const std::string &str,
+                              const _eval::Definitions &defs,
+                              _eval::FnMap fns = _eval::FnMap(),
+                              const _eval::Mode mode = _eval::Mode::Default) {
+  if (str.find('=') != std::string::npos) return _eval::compileStatements(str, defs, fns, mode);
+  return _eval::compile(_eval::lex(str), fns, mode, defs);
+}
+
+/**
+ Runs a compiled program with variables looked up by name. Use `_eval::run()` with slots on real-time threads.
+
+ @param[in] p
+ @param[in] vars (optional)
+ @returns result
+ */
+inline _eval::Number run(const _eval::Program &p, const _eval::VarMap &vars = _eval::VarMap()) {
+  const auto slots = _eval::bindSlots(p, vars);
+  return _eval::run(p, slots.data());
 }}
 #endif /* jgod_eval_h */
@@ -9,6 +9,14 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 #include "../eval.h"
+#include <random>
+#include <set>
+#include <thread>
+#ifdef EVAL_POSIX
+#include <csignal>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#endif
 using namespace jgod;
 
 double evalWithVar(const std::string &str,
@@ -53,6 +61,7 @@ TEST_CASE("variables")
 {
   SECTION("custom") {REQUIRE(evalWithVar("myvar", "myvar", 2) == 2);}
   SECTION("evals like any other number") {REQUIRE(evalWithVar("3 + myvar*3 - 2", "myvar", 5) == 16);}
+  SECTION("leading an expression") {REQUIRE(evalWithVar("myvar - 2", "myvar", 5) == 3);}
 }
 
 TEST_CASE("operators")
@@ -138,3 +147,949 @@ TEST_CASE("functions")
     }
   }
 }
+
+TEST_CASE("compiled programs")
+{
+  SECTION("match eval")
+  {
+    for (const auto &str : {"", "2.5*2 + 1.75", "3+4*2+6", "2^3", "5%2", "-(3*2)", "((-5+3) * (-8 + (-3 + 1)))",
+                            "+-(3-2)", "1 - - 3", "((3*(2-(3))*4()))()", "cos(pi)", "hypot(3, 4)", "abs(-3)"}) {
+      REQUIRE(run(compile(str)) == eval(str));
+    }
+  }
+
+  SECTION("variables are slots")
+  {
+    auto p = compile("3 + myvar*3 - myvar");
+    REQUIRE(p.vars.size() == 1);
+    const _eval::Number slots[] = {5};
+    REQUIRE(_eval::run(p, slots) == 13);
+    REQUIRE(p.slot("nope") == std::string::npos);
+    REQUIRE_THROWS_AS(run(p), const std::invalid_argument &);
+  }
+
+  SECTION("function args can be expressions") {REQUIRE(run(compile("hypot(1 + 2, sqrt(16))")) == 5);}
+
+  SECTION("errors")
+  {
+    REQUIRE_THROWS_AS(compile("(1 + 2"), const std::invalid_argument &);
+    REQUIRE_THROWS_AS(compile("1 +"), const std::domain_error &);
+    REQUIRE_THROWS_AS(compile("hypot(1)"), const std::domain_error &);
+  }
+
+  SECTION("real-time")
+  {
+    _eval::FnMap fns;
+    fns["function"] = [](_eval::FnArgs args) {return _eval::Type::toNumber(args[0]) + 1;};
+    REQUIRE(run(compile("function(2)", fns)) == 3);
+    REQUIRE_FALSE(compile("function(2)", fns).realtime());
+    REQUIRE_THROWS_AS(compile("function(2)", fns, _eval::Mode::Realtime), const std::invalid_argument &);
+    REQUIRE(compile("sin(x) + 1", fns, _eval::Mode::Realtime).realtime());
+  }
+}
+
+TEST_CASE("canonicalization")
+{
+  const auto same = [](const std::string &a, const std::string &b, bool reassociate) {
+    const auto x = _eval::canonical(compile(a), reassociate), y = _eval::canonical(compile(b), reassociate);
+    return _eval::structuralHash(x) == _eval::structuralHash(y) && x.vars == y.vars && _eval::serialize(x) == _eval::serialize(y);
+  };
+
+  REQUIRE(same("a+b", "b+a", false));
+  REQUIRE(same("2*x", "x*2", false));
+  REQUIRE(same("((a+b))+c", "c+(b+a)", false));
+  REQUIRE(same("x*(2+3)", "5*x", false));
+  REQUIRE(same("sin(y*x) - 1", "sin(x*y)-(1)", false));
+  REQUIRE_FALSE(same("a-b", "b-a", false));
+  REQUIRE_FALSE(same("a+(b+c)", "(a+b)+c", false));
+  REQUIRE(same("a+(b+c)", "(c+a)+b", true));
+  REQUIRE(same("2*x*3", "x*6", true));
+  REQUIRE_FALSE(same("a*(b+c)", "a*b+a*c", true));
+
+  SECTION("same results")
+  {
+    const _eval::VarMap vars = {{"a", 0.1}, {"b", 0.2}, {"x", -3}, {"y", 7}};
+    for (const auto &e : {"a + b*x", "(x+2)*(y-a) + 3*4", "hypot(y, x) % (y - a)", "-x + 2^a"}) {
+      const auto p = compile(e);
+      REQUIRE(run(_eval::canonical(p), vars) == run(p, vars));
+    }
+    REQUIRE(_eval::canonical(compile("1 + 2*3")).code.size() == 1);
+  }
+
+  SECTION("user functions")
+  {
+    _eval::FnMap fns;
+    fns["f"] = [](_eval::FnArgs args) {return _eval::Type::toNumber(args[0])*2;};
+    const auto p = _eval::canonical(compile("x + f(1)", fns));
+    REQUIRE(p.code.size() == 4); // f isn't folded
+    REQUIRE(run(p, {{"x", 1}}) == 3);
+
+    // Calls to functions with side effects stay in order.
+    _eval::Number calls = 0;
+    fns["zz"] = [&](_eval::FnArgs) {return calls = calls*10 + 1;};
+    fns["next"] = [&](_eval::FnArgs) {return calls = calls*10 + 2;};
+    const auto q = compile("zz(1) + next(1)", fns);
+    REQUIRE(run(q) == 13);
+    calls = 0;
+    REQUIRE(run(_eval::canonical(q)) == 13);
+    calls = 0;
+    REQUIRE(run(_eval::canonical(q, true)) == 13);
+  }
+}
+
+TEST_CASE("defined functions")
+{
+  _eval::Definitions defs;
+  _eval::define(defs, "f(x, y) = x^2 + y");
+  _eval::define(defs, "g(a) = f(a, 1)*k"); // k is the caller's
+  _eval::define(defs, "two() = 1 + 1");
+
+  const auto p = compile("f(a + 1, 2) + g(b) + two()", defs);
+  REQUIRE(p.realtime());
+  REQUIRE(run(p, {{"a", 2}, {"b", 3}, {"k", 10}}) == 11 + 100 + 2);
+  REQUIRE(run(compile("f(1, 2)*x", defs), {{"x", 2}}) == 6);
+  REQUIRE(compile("f(1, 2)*x", defs).code.size() == 3); // Folded to 3*x
+
+  SECTION("common subexpressions")
+  {
+    const auto q = compile("f(sin(x), y)/f(sin(x), y) + sin(x)", defs);
+    REQUIRE(std::count_if(q.code.begin(), q.code.end(), [](const _eval::Instr &i) {return i.op == _eval::Opcode::Native;}) == 1);
+    REQUIRE(std::count_if(q.code.begin(), q.code.end(), [](const _eval::Instr &i) {return i.op == _eval::Opcode::Pow;}) == 1);
+    const _eval::VarMap vars = {{"x", 0.3}, {"y", -2}};
+    REQUIRE(run(q, vars) == run(compile("(sin(x)^2 + y)/(sin(x)^2 + y) + sin(x)"), vars));
+
+    // Temporaries work on the batch path and survive serialization.
+    const std::vector<_eval::Number> x = {0.3, 1, 2}, y = {-2, 0, 5};
+    std::vector<const _eval::Number*> cols(2);
+    cols[q.slot("x")] = x.data(); cols[q.slot("y")] = y.data();
+    _eval::Number out[3];
+    _eval::runBatch(q, cols.data(), 3, out);
+    for (size_t i = 0; i < 3; ++i) REQUIRE(out[i] == run(q, {{"x", x[i]}, {"y", y[i]}}));
+    const auto image = _eval::serialize(q);
+    REQUIRE(run(_eval::deserialize(image.data(), image.size()), vars) == run(q, vars));
+  }
+
+  SECTION("errors")
+  {
+    REQUIRE_THROWS_AS(compile("f(1)", defs), const std::domain_error &);
+    REQUIRE_THROWS_AS(_eval::define(defs, "sin(x) = x"), const std::invalid_argument &);
+    REQUIRE_THROWS_AS(_eval::define(defs, "h(x, x) = x"), const std::invalid_argument &);
+    REQUIRE_THROWS_AS(_eval::define(defs, "h(x) x"), const std::invalid_argument &);
+    _eval::FnMap fns;
+    fns["now"] = [](_eval::FnArgs) {return 1;};
+    _eval::define(defs, "later(x) = now() + x", fns);
+    REQUIRE(run(compile("later(1)", defs)) == 2);
+    REQUIRE_THROWS_AS(compile("later(1)", defs, _eval::FnMap(), _eval::Mode::Realtime), const std::invalid_argument &);
+  }
+}
+
+TEST_CASE("statements")
+{
+  const auto p = compile("t = a*b; u = t + c;\n ratio = t/u; root = sqrt(u);");
+  REQUIRE((p.outputs == std::vector<std::string>{"ratio", "root"}));
+  REQUIRE(std::count_if(p.code.begin(), p.code.end(), [](const _eval::Instr &i) {return i.op == _eval::Opcode::Mul;}) == 1);
+  REQUIRE(std::count_if(p.code.begin(), p.code.end(), [](const _eval::Instr &i) {return i.op == _eval::Opcode::Add;}) == 1);
+
+  const auto check = [&](_eval::Number a, _eval::Number b, _eval::Number c, const _eval::Number *out) {
+    return out[0] == (a*b)/(a*b + c) && out[1] == std::sqrt(a*b + c);
+  };
+  std::vector<_eval::Number> slots(3);
+  slots[p.slot("a")] = 2; slots[p.slot("b")] = 3; slots[p.slot("c")] = 4;
+  _eval::Number out[2];
+  REQUIRE(_eval::run(p, slots.data(), out) == out[0]);
+  REQUIRE(check(2, 3, 4, out));
+
+  SECTION("batches")
+  {
+    const size_t n = 1000;
+    std::vector<_eval::Number> a(n), b(n), c(n), ratio(n), root(n);
+    for (size_t i = 0; i < n; ++i) {a[i] = static_cast<_eval::Number>(i); b[i] = 0.5; c[i] = 1;}
+    std::vector<_eval::Column> cols(3);
+    cols[p.slot("a")] = a.data(); cols[p.slot("b")] = b.data(); cols[p.slot("c")] = c.data();
+    _eval::Number *outs[] = {ratio.data(), root.data()};
+    _eval::runBatch(p, cols.data(), n, outs);
+    for (size_t i = 0; i < n; ++i) {const _eval::Number o[] = {ratio[i], root[i]}; REQUIRE(check(a[i], 0.5, 1, o));}
+  }
+
+  SECTION("temporaries share registers")
+  {
+    const auto q = compile("x = (a*b)/(a*b + 1); y = (c - d)*(c - d)");
+    REQUIRE(std::count_if(q.code.begin(), q.code.end(), [](const _eval::Instr &i) {return i.op == _eval::Opcode::Mul;}) == 2);
+    REQUIRE(q.depth == _eval::canonical(compile("x = (a*b)/(a*b + 1); y = 0")).depth);
+    REQUIRE(run(q, {{"a", 2}, {"b", 3}, {"c", 5}, {"d", 1}}) == 6.0/7);
+  }
+
+  SECTION("locals calling user functions")
+  {
+    size_t calls = 0;
+    _eval::FnMap fns;
+    fns["f"] = [&](_eval::FnArgs args) {++calls; return _eval::Type::toNumber(args[0]) + 1;};
+    const auto q = _eval::compileStatements("t = f(a); o = t + 1; q = t*2; t = f(t) + t; r = t", {}, fns);
+    REQUIRE((q.outputs == std::vector<std::string>{"o", "q", "r"}));
+    _eval::Number out[3];
+    const _eval::Number a = 2;
+    REQUIRE(_eval::run(q, &a, out) == 4);
+    REQUIRE(calls == 2);
+    REQUIRE(out[1] == 6);
+    REQUIRE(out[2] == 7);
+  }
+
+  SECTION("reassignment and definitions")
+  {
+    _eval::Definitions defs;
+    _eval::define(defs, "sq(x) = x*x");
+    const auto q = compile("t = 1 + x; t = sq(t); y = t - 1", defs);
+    REQUIRE((q.outputs == std::vector<std::string>{"y"}));
+    REQUIRE(run(q, {{"x", 2}}) == 8);
+    REQUIRE(_eval::canonical(q).outputs == q.outputs);
+  }
+
+  SECTION("errors")
+  {
+    REQUIRE_THROWS_AS(compile("t = 1; 2"), const std::invalid_argument &);
+    REQUIRE_THROWS_AS(compile("pi = 3"), const std::invalid_argument &);
+    REQUIRE_THROWS_AS(compile("a ="), const std::invalid_argument &);
+    REQUIRE_THROWS_AS(compile("t = 1; u =  ;"), const std::invalid_argument &);
+    REQUIRE_THROWS_AS(_eval::serialize(p), const std::invalid_argument &);
+  }
+}
+
+TEST_CASE("expression templates")
+{
+  using namespace _eval::Dsl;
+  const auto e = 3*var("x") + sin(var("y")) - pow(var("x"), 2)/hypot(var("y"), 4) % 5;
+  const std::string str = "3*x + sin(y) - x^2/hypot(y, 4) % 5";
+  const auto p = _eval::Dsl::compile(e);
+  REQUIRE(_eval::serialize(p) == _eval::serialize(_eval::canonical(::compile(str))));
+
+  const auto f = bind(e, p.vars);
+  _eval::Number slots[2];
+  for (int i = -3; i < 3; ++i) {
+    slots[p.slot("x")] = i; slots[p.slot("y")] = 0.5*i;
+    REQUIRE(f(slots) == _eval::run(p, slots));
+    REQUIRE(f(slots) == run(::compile(str), {{"x", i}, {"y", 0.5*i}}));
+  }
+
+  REQUIRE(_eval::Dsl::compile(-(var("x")*(1 + 2))).code.size() == 5); // 0 - 3*x
+  REQUIRE_THROWS_AS(bind(var("z"), p.vars), const std::invalid_argument &);
+}
+
+TEST_CASE("real-time channel")
+{
+  SECTION("spsc queue")
+  {
+    _eval::SpscQueue<int, 4> q;
+    REQUIRE(q.push(1)); REQUIRE(q.push(2)); REQUIRE(q.push(3));
+    REQUIRE_FALSE(q.push(4));
+    int i = 0;
+    REQUIRE(q.pop(i)); REQUIRE(i == 1);
+    REQUIRE(*q.peek() == 2);
+  }
+
+  SECTION("applies updates at the start of a cycle")
+  {
+    _eval::RealtimeChannel<> channel;
+    REQUIRE(std::isnan(channel.run()));
+    REQUIRE(channel.swap(compile("x*2 + y", _eval::FnMap(), _eval::Mode::Realtime)));
+    REQUIRE(channel.set("x", 3)); REQUIRE(channel.set("y", 1));
+    REQUIRE_FALSE(channel.set("z", 1));
+    REQUIRE(channel.apply() == 3);
+    REQUIRE(channel.run() == 7);
+    REQUIRE(channel.swap(compile("y - x")));
+    REQUIRE(channel.set("x", 1));
+    REQUIRE(channel.apply() == 2);
+    REQUIRE(channel.run() == -1);
+    channel.collect();
+  }
+
+  SECTION("rejects programs that aren't real-time safe")
+  {
+    _eval::RealtimeChannel<> channel;
+    _eval::FnMap fns;
+    fns["function"] = [](_eval::FnArgs) {return 1;};
+    REQUIRE_THROWS_AS(channel.swap(compile("function()", fns)), const std::invalid_argument &);
+  }
+
+  SECTION("across threads")
+  {
+    _eval::RealtimeChannel<16> channel;
+    const int updates = 10000;
+    std::thread producer([&]() {
+      while (!channel.swap(compile("x + 1"))) {}
+      for (int i = 1; i <= updates; ++i) while (!channel.set("x", i)) {}
+    });
+    _eval::Number last = 0;
+    auto ordered = true;
+    while (last != updates + 1) {
+      channel.apply();
+      const auto result = channel.run();
+      if (!std::isnan(result)) {ordered = ordered && result >= last; last = result;}
+    }
+    producer.join();
+    REQUIRE(ordered);
+  }
+}
+
+TEST_CASE("memoization")
+{
+  const auto p = compile("x*y + sin(x)");
+  _eval::Number slots[2] = {};
+
+  SECTION("caches by exact inputs")
+  {
+    _eval::MemoTable memo(p, 64);
+    for (int round = 0; round < 2; ++round) for (int i = 0; i < 16; ++i) {
+      slots[0] = i; slots[1] = i/2;
+      REQUIRE(memo.run(slots) == run(p, slots));
+    }
+    REQUIRE(memo.stats().misses == 16); REQUIRE(memo.stats().hits == 16);
+    slots[0] = -0.0; slots[1] = 0;
+    memo.run(slots);
+    REQUIRE(memo.stats().misses == 17); // -0 isn't 0
+  }
+
+  SECTION("evicts when full")
+  {
+    _eval::MemoTable memo(p, 8, 0);
+    for (int i = 0; i < 100; ++i) {slots[0] = i; REQUIRE(memo.run(slots) == run(p, slots));}
+    REQUIRE(memo.stats().evictions == 92);
+  }
+
+  SECTION("turns off when it doesn't help")
+  {
+    _eval::MemoTable memo(p, 64, 0.5, 32);
+    for (int i = 0; i < 64; ++i) {slots[0] = i; REQUIRE(memo.run(slots) == run(p, slots));}
+    REQUIRE_FALSE(memo.stats().enabled);
+    REQUIRE(memo.stats().misses == 32);
+    memo.clear();
+    REQUIRE(memo.stats().enabled);
+  }
+
+  SECTION("no variables")
+  {
+    _eval::MemoTable memo(compile("2^10 + 1"));
+    REQUIRE(memo.run(nullptr) == 1025);
+    REQUIRE(memo.run(nullptr) == 1025);
+    REQUIRE(memo.stats().hits == 1);
+  }
+
+  SECTION("rejects user functions")
+  {
+    _eval::FnMap fns;
+    fns["now"] = [](_eval::FnArgs) {return 1;};
+    REQUIRE_THROWS_AS(_eval::MemoTable(compile("now() + x", fns)), const std::invalid_argument &);
+  }
+}
+
+TEST_CASE("batch evaluation")
+{
+  const auto p = compile("x*2 + hypot(x, y) - y%3");
+  const size_t n = 10000;
+  std::vector<_eval::Number> x(n), y(n), out(n);
+  for (size_t i = 0; i < n; ++i) {x[i] = static_cast<_eval::Number>(i)*0.5; y[i] = 100 - x[i]/2;}
+  const _eval::Number *cols[] = {x.data(), y.data()};
+  const auto CHECK_ROWS = [&]() {
+    for (size_t i = 0; i < n; i += 997) {const _eval::Number slots[] = {x[i], y[i]}; REQUIRE(out[i] == _eval::run(p, slots));}
+  };
+
+  SECTION("single thread") {_eval::runBatch(p, cols, n, out.data()); CHECK_ROWS();}
+  SECTION("thread pool")
+  {
+    _eval::ThreadPool pool(3);
+    _eval::runBatch(pool, p, cols, n, out.data());
+    CHECK_ROWS();
+  }
+  SECTION("pinned pool")
+  {
+    _eval::ThreadPool pool(3, _eval::Placement::Pinned);
+    std::vector<std::thread::id> ran(pool.size());
+    for (size_t w = 0; w < pool.size(); ++w) pool.submit([&, w]() {ran[w] = std::this_thread::get_id();}, w).get();
+    REQUIRE(std::set<std::thread::id>(ran.begin(), ran.end()).size() == pool.size());
+    REQUIRE(pool.unpinned() <= pool.size());
+    REQUIRE_FALSE(_eval::pinTo(1 << 20));
+
+    _eval::PageBuffer results(n);
+    _eval::firstTouch(pool, results.data(), n);
+    REQUIRE(std::all_of(results.data(), results.data() + n, [](_eval::Number v) {return v == 0;}));
+    _eval::runBatch(pool, p, cols, n, results.data());
+    std::copy(results.data(), results.data() + n, out.begin());
+    CHECK_ROWS();
+  }
+  SECTION("huge pages")
+  {
+    const auto &stats = _eval::pageStats();
+    const auto before = stats.hugeTlb + stats.transparent + stats.fallbacks;
+    _eval::PageBuffer results(n, _eval::Pages::Huge);
+    REQUIRE(stats.hugeTlb + stats.transparent + stats.fallbacks == before + 1);
+    _eval::runBatch(p, cols, n, results.data());
+    std::copy(results.data(), results.data() + n, out.begin());
+    CHECK_ROWS();
+    REQUIRE(_eval::PageBuffer(n).backing() == _eval::Backing::Normal);
+  }
+  SECTION("block size")
+  {
+    const auto budget = _eval::blockBudget().load();
+    REQUIRE(_eval::blockRows(p)*p.depth*sizeof(_eval::Number) <= budget);
+    _eval::blockBudget() = 1;
+    REQUIRE(_eval::blockRows(p) == 16);
+    _eval::runBatch(p, cols, n, out.data());
+    CHECK_ROWS();
+
+    const auto path = "/tmp/eval_block_profile";
+    _eval::blockBudget() = 1 << 16;
+    _eval::saveBlockProfile(path);
+    _eval::blockBudget() = budget;
+    REQUIRE(_eval::loadBlockProfile(path));
+    REQUIRE(_eval::blockBudget() == 1 << 16);
+    std::remove(path);
+    REQUIRE(!_eval::loadBlockProfile(path));
+
+    REQUIRE(_eval::tuneBlocks() == _eval::blockBudget());
+    _eval::runBatch(p, cols, n, out.data());
+    CHECK_ROWS();
+    _eval::blockBudget() = budget;
+  }
+  SECTION("user functions")
+  {
+    _eval::FnMap fns;
+    fns["twice"] = [](_eval::FnArgs args) {return 2*_eval::Type::toNumber(args[0]);};
+    const auto q = compile("twice(x) + 1", fns);
+    _eval::runBatch(q, cols, 3, out.data());
+    REQUIRE(out[2] == 3);
+  }
+}
+
+TEST_CASE("serialization")
+{
+  const auto p = compile("hypot(x, 4) + pi*y");
+  const auto image = _eval::serialize(p);
+  const auto q = _eval::deserialize(image.data(), image.size());
+  REQUIRE(q.vars == p.vars);
+  REQUIRE(run(q, {{"x", 3}, {"y", 2}}) == run(p, {{"x", 3}, {"y", 2}}));
+  REQUIRE_THROWS_AS(_eval::deserialize(image.data(), 8), const std::invalid_argument &);
+
+  SECTION("tampered images")
+  {
+    const auto tamper = [&](const size_t offset, const uint32_t value) {
+      auto bad = image;
+      std::memcpy(&bad[offset], &value, sizeof(value));
+      return bad;
+    };
+    const auto instr = sizeof(_eval::ImageHeader);
+    for (const auto &bad : {tamper(offsetof(_eval::ImageHeader, depth), 100000), tamper(offsetof(_eval::ImageHeader, depth), 1),
+                            tamper(instr + offsetof(_eval::ImageInstr, idx), 5000), tamper(instr + offsetof(_eval::ImageInstr, op), 200),
+                            tamper(instr + offsetof(_eval::ImageInstr, op), static_cast<uint32_t>(_eval::Opcode::Load)),
+                            tamper(instr + offsetof(_eval::ImageInstr, op), static_cast<uint32_t>(_eval::Opcode::Add))}) {
+      REQUIRE_THROWS_AS(_eval::deserialize(bad.data(), bad.size()), const std::invalid_argument &);
+    }
+
+    // Constants claiming an arity would push without popping, past the stack.
+    _eval::Program pushes;
+    pushes.consts.push_back(2);
+    pushes.depth = 1;
+    pushes.code.push_back({_eval::Opcode::Const, 0, 0});
+    for (int i = 0; i < 200; ++i) pushes.code.push_back({_eval::Opcode::Const, 1, 0});
+    const auto bad = _eval::serialize(pushes);
+    REQUIRE_THROWS_AS(_eval::deserialize(bad.data(), bad.size()), const std::invalid_argument &);
+    pushes.code.resize(1);
+    const auto good = _eval::serialize(pushes);
+    REQUIRE(run(_eval::deserialize(good.data(), good.size())) == 2);
+  }
+
+  _eval::FnMap fns;
+  fns["function"] = [](_eval::FnArgs) {return 1;};
+  REQUIRE_THROWS_AS(_eval::serialize(compile("function()", fns)), const std::invalid_argument &);
+}
+
+TEST_CASE("selections")
+{
+  const auto p = compile("a*2 + b");
+  const size_t n = 1000;
+  std::vector<_eval::Number> a(n), b(n), all(n);
+  for (size_t i = 0; i < n; ++i) {a[i] = static_cast<_eval::Number>(i); b[i] = 1;}
+  const _eval::Column cols[] = {a.data(), b.data()};
+  _eval::runBatch(p, cols, n, all.data());
+
+  std::vector<uint32_t> selection;
+  std::vector<uint64_t> bitmap((n + 63)/64 + 1, ~0ull); // Bits past the last row are ignored.
+  for (size_t i = 0; i < n; ++i) {
+    if (i % 3 == 0) selection.push_back(static_cast<uint32_t>(i));
+    else bitmap[i/64] &= ~(1ull << (i % 64));
+  }
+
+  SECTION("compacted")
+  {
+    std::vector<_eval::Number> out(selection.size());
+    _eval::runSelected(p, cols, selection.data(), selection.size(), out.data());
+    for (size_t i = 0; i < selection.size(); ++i) REQUIRE(out[i] == all[selection[i]]);
+    std::fill(out.begin(), out.end(), 0);
+    REQUIRE(_eval::runSelected(p, cols, bitmap.data(), n, out.data()) == selection.size());
+    for (size_t i = 0; i < selection.size(); ++i) REQUIRE(out[i] == all[selection[i]]);
+  }
+
+  SECTION("scattered")
+  {
+    std::vector<_eval::Number> out(n, -1);
+    REQUIRE(_eval::runSelected(p, cols, bitmap.data(), n, out.data(), _eval::Output::Scatter) == selection.size());
+    for (size_t i = 0; i < n; ++i) REQUIRE(out[i] == (i % 3 == 0 ? all[i] : -1));
+  }
+}
+
+TEST_CASE("single flight")
+{
+  _eval::SingleFlight<std::string, int> flights;
+  const size_t callers = 4;
+  std::atomic<int> calls(0);
+  std::vector<int> results(callers);
+
+  SECTION("concurrent callers share one computation")
+  {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < callers; ++i) threads.emplace_back([&, i]() {
+      results[i] = flights.run("x", [&]() {
+        ++calls;
+        while (flights.shared < callers - 1) std::this_thread::yield(); // Hold the flight open until everyone's waiting.
+        return 42;
+      });
+    });
+    for (auto &t : threads) t.join();
+    REQUIRE(calls == 1);
+    REQUIRE((results == std::vector<int>(callers, 42)));
+    REQUIRE(flights.run("x", [&]() {return ++calls;}) == 2); // Nothing's kept once it lands.
+  }
+
+  SECTION("errors reach callers and aren't kept")
+  {
+    REQUIRE_THROWS_AS(flights.run("x", []() -> int {throw std::runtime_error("no");}), const std::runtime_error &);
+    REQUIRE(flights.run("x", []() {return 1;}) == 1);
+  }
+}
+
+TEST_CASE("heterogeneous batches")
+{
+  const auto sum = compile("a + b"), square = compile("x^2"), constant = compile("pi");
+  std::vector<_eval::Number> values(300);
+  std::vector<_eval::Item> items;
+  for (size_t i = 0; i < 100; ++i) {
+    values[i*3] = static_cast<_eval::Number>(i); values[i*3 + 1] = 1;
+    const _eval::Program *programs[] = {&sum, &square, &constant};
+    items.push_back({programs[i % 3], &values[i*3]});
+  }
+  const auto CHECK_ITEMS = [&](const std::vector<_eval::Number> &out) {
+    for (size_t i = 0; i < items.size(); ++i) REQUIRE(out[i] == _eval::run(*items[i].program, items[i].slots));
+  };
+  REQUIRE(_eval::groupItems(items.data(), items.size()).size() == 3);
+
+  std::vector<_eval::Number> out(items.size());
+  SECTION("single thread") {_eval::runHeterogeneous(items.data(), items.size(), out.data()); CHECK_ITEMS(out);}
+  SECTION("thread pool")
+  {
+    _eval::ThreadPool pool(2);
+    _eval::runHeterogeneous(pool, items.data(), items.size(), out.data());
+    CHECK_ITEMS(out);
+  }
+}
+
+TEST_CASE("group by")
+{
+  const size_t n = 10000;
+  std::vector<_eval::Number> price(n), qty(n);
+  std::vector<int32_t> account(n);
+  std::map<int64_t, _eval::Summary> expected;
+  for (size_t i = 0; i < n; ++i) {
+    price[i] = static_cast<_eval::Number>(i % 100); qty[i] = 2; account[i] = static_cast<int32_t>(i*7 % 37) - 18;
+    expected[account[i]].add(price[i]*qty[i]);
+  }
+  const auto p = compile("price*qty");
+  const _eval::Column cols[] = {price.data(), qty.data()};
+  const _eval::Column keys(account.data(), sizeof(int32_t), _eval::FieldType::I32);
+  const auto CHECK_GROUPS = [&](const std::vector<std::pair<int64_t, _eval::Summary>> &groups) {
+    REQUIRE(groups.size() == expected.size());
+    for (const auto &g : groups) {
+      const auto &e = expected[g.first];
+      REQUIRE(g.second.count == e.count); REQUIRE(g.second.sum == e.sum);
+      REQUIRE(g.second.min == e.min); REQUIRE(g.second.max == e.max);
+    }
+  };
+
+  SECTION("single table")
+  {
+    _eval::SummaryTable table(4); // Grows as keys arrive.
+    _eval::aggregate(p, cols, keys, n, table);
+    CHECK_GROUPS(table.sorted());
+  }
+  SECTION("per-thread tables")
+  {
+    _eval::ThreadPool pool(3);
+    CHECK_GROUPS(_eval::aggregate(pool, p, cols, keys, n));
+  }
+}
+
+TEST_CASE("top k")
+{
+  const size_t n = 5000;
+  std::vector<_eval::Number> x(n);
+  for (size_t i = 0; i < n; ++i) x[i] = static_cast<_eval::Number>((i*7919) % 1000); // Lots of ties
+  x[42] = std::nan("");
+  const auto p = compile("x*2");
+  const _eval::Column cols[] = {x.data()};
+
+  std::vector<_eval::Ranked> expected;
+  for (size_t i = 0; i < n; ++i) if (!std::isnan(x[i])) expected.push_back({i, x[i]*2});
+  std::sort(expected.begin(), expected.end(), _eval::ranksBefore);
+  expected.resize(10);
+  const auto CHECK_RANKS = [&](const std::vector<_eval::Ranked> &best) {
+    REQUIRE(best.size() == expected.size());
+    for (size_t i = 0; i < best.size(); ++i) {REQUIRE(best[i].row == expected[i].row); REQUIRE(best[i].score == expected[i].score);}
+  };
+
+  SECTION("single thread") {CHECK_RANKS(_eval::topK(p, cols, n, 10));}
+  SECTION("per-thread heaps") {_eval::ThreadPool pool(3); CHECK_RANKS(_eval::topK(pool, p, cols, n, 10));}
+  SECTION("k beyond n") {REQUIRE(_eval::topK(p, cols, 5, 10).size() == 5);}
+}
+
+TEST_CASE("live editing")
+{
+  const size_t n = 1000;
+  std::vector<_eval::Number> x(n), y(n);
+  for (size_t i = 0; i < n; ++i) {x[i] = static_cast<_eval::Number>(i); y[i] = 0.5*static_cast<_eval::Number>(i);}
+  _eval::LiveFormula live({{"x", x.data()}, {"y", y.data()}}, n);
+  const auto expect = [&](const std::string &e) {
+    const auto p = compile(e);
+    for (size_t i = 0; i < n; i += 97) if (live.results()[i] != run(p, {{"x", x[i]}, {"y", y[i]}})) return false;
+    return live.results().size() == n;
+  };
+
+  live.edit("sqrt(x*y) + 1");
+  REQUIRE(expect("sqrt(x*y) + 1"));
+  const auto evaluated = live.stats.evaluated;
+
+  live.edit(13, 13, "2"); // "sqrt(x*y) + 12"
+  REQUIRE(live.text() == "sqrt(x*y) + 12");
+  REQUIRE(expect("sqrt(x*y) + 12"));
+  REQUIRE(live.stats.evaluated == evaluated + 2); // The constant and the sum; sqrt(x*y) was reused.
+
+  REQUIRE_THROWS_AS(live.edit(0, 4, "sqrt("), const std::invalid_argument &); // Mid-edit
+  REQUIRE(expect("sqrt(x*y) + 12"));
+  live.edit(0, 5, "12 + sqrt");
+  REQUIRE(live.text() == "12 + sqrt(x*y) + 12");
+  REQUIRE(expect("12 + sqrt(x*y) + 12"));
+
+  REQUIRE_THROWS_AS(live.edit("z"), const std::invalid_argument &);
+  const auto before = live.stats.evaluated;
+  live.edit("sqrt(x*y)*2"); // sqrt(x*y) was kept inside a reused subtree, and through the failed edit
+  REQUIRE(expect("sqrt(x*y)*2"));
+  REQUIRE(live.stats.evaluated == before + 2);
+  REQUIRE_THROWS_AS(live.edit(5, 4, ""), const std::out_of_range &);
+}
+
+TEST_CASE("struct binding")
+{
+  struct Trade {std::string symbol; double price; float fee; int32_t qty; bool buy; char pad[64 + 7];}; // pad fills the tail, so there is no implicit padding
+  std::vector<Trade> trades(5000);
+  for (size_t i = 0; i < trades.size(); ++i) {
+    trades[i].price = static_cast<double>(i)/4;
+    trades[i].fee = 0.5f;
+    trades[i].qty = static_cast<int32_t>(i % 7) - 3;
+    trades[i].buy = i % 2 == 0;
+  }
+  const auto binding = _eval::StructBinding<Trade>()
+    .bind("price", &Trade::price).bind("fee", &Trade::fee).bind("qty", &Trade::qty).bind("buy", &Trade::buy);
+  const auto p = compile("price*qty - fee + buy");
+  std::vector<_eval::Number> out(trades.size());
+  const auto CHECK_ROWS = [&]() {
+    for (size_t i = 0; i < trades.size(); i += 101) REQUIRE(out[i] == trades[i].price*trades[i].qty - 0.5 + (trades[i].buy ? 1 : 0));
+  };
+
+  SECTION("single thread") {binding.run(p, trades.data(), trades.size(), out.data()); CHECK_ROWS();}
+  SECTION("thread pool")
+  {
+    _eval::ThreadPool pool(2);
+    binding.run(pool, p, trades.data(), trades.size(), out.data());
+    CHECK_ROWS();
+  }
+}
+
+TEST_CASE("number parsing")
+{
+  const auto PARSE = [](const std::string &s) {
+    _eval::Number n = -1;
+    const auto end = _eval::Parse::number(s.data(), s.data() + s.size(), n);
+    return std::make_pair(n, static_cast<size_t>(end - s.data()));
+  };
+
+  SECTION("matches strtod")
+  {
+    for (const auto s : {"0", "-0", "7", "12345678", "123456789012", "3.14159", "-2.5e3", "1e-22", "9007199254740993",
+                         "0.1", "123456.789e-5", "1234567890123456789012345", "2.2250738585072014e-308", "1.7976931348623157e308",
+                         "4.9e-324", ".5", "5.", "+8", "0.30000000000000004"}) {
+      INFO(s);
+      REQUIRE(PARSE(s).first == std::strtod(s, nullptr));
+      REQUIRE(PARSE(s).second == std::string(s).size());
+    }
+  }
+
+  SECTION("stops at the end of the number")
+  {
+    REQUIRE(PARSE("12.5e").second == 4);
+    REQUIRE(PARSE("3,4").second == 1);
+    REQUIRE(PARSE("abc").second == 0);
+    REQUIRE(PARSE("-.").second == 0);
+    REQUIRE(PARSE("1e999").first == std::numeric_limits<_eval::Number>::infinity());
+  }
+
+  SECTION("lists")
+  {
+    std::vector<_eval::Number> out;
+    const std::string csv = "1.5, -2,,x,1e3";
+    REQUIRE(_eval::Parse::list(csv.data(), csv.data() + csv.size(), ',', out) == 5);
+    REQUIRE(out[0] == 1.5); REQUIRE(out[1] == -2); REQUIRE(std::isnan(out[2])); REQUIRE(std::isnan(out[3])); REQUIRE(out[4] == 1000);
+  }
+
+  SECTION("lexer") {REQUIRE(eval("0.1 + 0.2") == 0.1 + 0.2);}
+}
+
+TEST_CASE("number formatting")
+{
+  const auto FORMAT = [](const _eval::Number n) {char buf[_eval::Format::SIZE]; return std::string(buf, _eval::Format::number(n, buf));};
+
+  SECTION("shortest")
+  {
+    REQUIRE(FORMAT(0) == "0"); REQUIRE(FORMAT(-0.0) == "-0");
+    REQUIRE(FORMAT(3) == "3"); REQUIRE(FORMAT(-1500) == "-1500");
+    REQUIRE(FORMAT(0.1) == "0.1"); REQUIRE(FORMAT(2.5) == "2.5");
+    REQUIRE(FORMAT(0.1 + 0.2) == "0.30000000000000004");
+    REQUIRE(FORMAT(1e-7) == "1e-7"); REQUIRE(FORMAT(0.000123) == "0.000123");
+    REQUIRE(FORMAT(1e22) == "1e22"); REQUIRE(FORMAT(123456789012345680000.0) == "123456789012345680000");
+    REQUIRE(FORMAT(std::numeric_limits<_eval::Number>::denorm_min()) == "5e-324");
+    REQUIRE(FORMAT(std::strtod("4.66706551586069e-310", nullptr)) == "4.6670655158607e-310");
+    REQUIRE(FORMAT(std::nan("")) == "nan"); REQUIRE(FORMAT(-std::numeric_limits<_eval::Number>::infinity()) == "-inf");
+  }
+
+  SECTION("round trips")
+  {
+    std::mt19937_64 rng(7);
+    for (int i = 0; i < 20000; ++i) {
+      uint64_t bits = rng();
+      _eval::Number v;
+      std::memcpy(&v, &bits, sizeof(v));
+      if (!std::isfinite(v)) continue;
+      const auto s = FORMAT(v);
+      INFO(s);
+      REQUIRE(std::strtod(s.c_str(), nullptr) == v);
+    }
+  }
+
+  SECTION("writers")
+  {
+    const _eval::Number a[] = {1, 0.5}, b[] = {-2, std::nan("")};
+    const _eval::Number *cols[] = {a, b};
+    std::ostringstream csv, ndjson;
+    _eval::Format::csv(csv, {"a", "b"}, cols, 2);
+    _eval::Format::ndjson(ndjson, {"a", "b"}, cols, 2);
+    REQUIRE(csv.str() == "a,b\n1,-2\n0.5,nan\n");
+    REQUIRE(ndjson.str() == "{\"a\":1,\"b\":-2}\n{\"a\":0.5,\"b\":null}\n");
+  }
+}
+
+TEST_CASE("ndjson")
+{
+  const auto p = compile("price*qty + fee");
+  _eval::NdjsonReader reader(p, 2);
+
+  SECTION("extracts referenced fields")
+  {
+    const std::string record = R"({"id": "a\"b", "qty": 3, "nested": {"price": 100, "x": [1, {"y": 2}]}, "price": -1.5e1, "fee": null})";
+    _eval::Number values[3];
+    REQUIRE(reader.extract(record.data(), record.data() + record.size(), values));
+    REQUIRE(values[p.slot("price")] == -15);
+    REQUIRE(values[p.slot("qty")] == 3);
+    REQUIRE(std::isnan(values[p.slot("fee")]));
+    REQUIRE_FALSE(reader.extract(record.data() + 1, record.data() + record.size(), values));
+  }
+
+  SECTION("evaluates a stream in blocks")
+  {
+    std::istringstream in("{\"price\": 2, \"qty\": 3, \"fee\": 1}\n\n{\"fee\":0,\"qty\":1,\"price\":0.5}\n{\"price\": 1, \"qty\": 1, \"fee\": 1}");
+    std::vector<_eval::Number> out;
+    size_t blocks = 0;
+    REQUIRE(reader.run(in, [&](const _eval::Number *results, size_t n) {out.insert(out.end(), results, results + n); ++blocks;}) == 3);
+    REQUIRE((out == std::vector<_eval::Number>{7, 0.5, 2}));
+    REQUIRE(blocks == 2);
+  }
+
+  SECTION("records longer than the buffer")
+  {
+    std::istringstream in("{\"price\": 2, \"note\": \"" + std::string(3 << 20, 'x') + "\", \"qty\": 3, \"fee\": 1}\n{\"price\": 1, \"qty\": 1, \"fee\": 1}");
+    std::vector<_eval::Number> out;
+    REQUIRE(reader.run(in, [&](const _eval::Number *results, size_t n) {out.insert(out.end(), results, results + n);}) == 2);
+    REQUIRE((out == std::vector<_eval::Number>{7, 2}));
+  }
+}
+
+#ifdef EVAL_POSIX
+TEST_CASE("shared cache")
+{
+  const std::string name = "/eval-test-" + std::to_string(getpid());
+  _eval::SharedCache::unlink(name);
+  {
+    _eval::SharedCache cache(name, 64, 4096);
+    REQUIRE(cache.compile("x*2 + 1").vars.size() == 1);
+    REQUIRE(cache.stats.published == 1);
+
+    // Another process finds what this one published, and publishes its own.
+    const auto pid = fork();
+    if (pid == 0) {
+      _eval::SharedCache child(name, 64, 4096);
+      const auto p = child.compile("x*2 + 1");
+      child.compile("y - 1");
+      _exit(child.stats.hits == 1 && run(p, {{"x", 3}}) == 7 ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    REQUIRE(WEXITSTATUS(status) == 0);
+    _eval::Program p;
+    REQUIRE(cache.find("y - 1", p));
+    REQUIRE(run(p, {{"y", 3}}) == 2);
+    REQUIRE_FALSE(cache.find("y - 2", p));
+    REQUIRE_THROWS_AS(_eval::SharedCache(name, 32, 4096), const std::invalid_argument &);
+  }
+  _eval::SharedCache::unlink(name);
+
+  // A creator that died before setting the segment up.
+  const auto fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  REQUIRE(fd >= 0);
+  close(fd);
+  REQUIRE_THROWS_AS(_eval::SharedCache(name, 64, 4096), const std::runtime_error &);
+  _eval::SharedCache::unlink(name);
+}
+#endif
+
+#ifdef EVAL_POSIX
+TEST_CASE("sharded evaluation")
+{
+  const std::string path = "/tmp/eval-test-" + std::to_string(getpid()) + ".evc";
+  const size_t n = 200000;
+  std::vector<_eval::Number> a(n), b(n);
+  for (size_t i = 0; i < n; ++i) {a[i] = static_cast<_eval::Number>(i); b[i] = 3;}
+  const _eval::Number *cols[] = {a.data(), b.data()};
+  _eval::ColumnFile::write(path, {"a", "b"}, cols, n);
+
+  SECTION("column file")
+  {
+    const _eval::ColumnFile file(path);
+    REQUIRE(file.rows() == n);
+    REQUIRE(file.column("b") == 1);
+    _eval::Number v[2];
+    file.read(0, 100, 2, v);
+    REQUIRE(v[1] == 101);
+  }
+
+  SECTION("corrupt column files")
+  {
+    const auto bad = path + ".bad";
+    const auto tamper = [&](const long offset, const uint64_t value, const size_t bytes) {
+      _eval::ColumnFile::write(bad, {"a", "b"}, cols, 4);
+      const auto file = std::fopen(bad.c_str(), "r+b");
+      std::fseek(file, offset, SEEK_SET);
+      std::fwrite(&value, bytes, 1, file);
+      std::fclose(file);
+      REQUIRE_THROWS_AS(_eval::ColumnFile(bad.c_str()), const std::invalid_argument &);
+    };
+    tamper(4, 1000, 4); // More columns than names
+    tamper(8, 1ull << 40, 8); // More rows than data
+    tamper(16, 1ull << 40, 8); // Data past the end
+    tamper(16, 24 + 3, 8); // Names "a\0b": the last one is cut off
+    std::remove(bad.c_str());
+  }
+
+  SECTION("merges results in order")
+  {
+    std::vector<_eval::Number> out;
+    const auto summary = _eval::runSharded(compile("a*b + 1"), path, 3, &out);
+    REQUIRE(out.size() == n);
+    for (size_t i = 0; i < n; i += 9973) REQUIRE(out[i] == a[i]*3 + 1);
+    REQUIRE(summary.count == n);
+    REQUIRE(summary.max == (n - 1)*3 + 1);
+  }
+
+  SECTION("reductions only")
+  {
+    const auto summary = _eval::runSharded(compile("b"), path, 4);
+    REQUIRE(summary.sum == 3*n);
+    REQUIRE(summary.mean() == 3);
+    REQUIRE(_eval::runSharded(compile("b"), path, 0).sum == 3*n); // 0 workers is 1
+  }
+
+  SECTION("out of core")
+  {
+    const auto out = path + ".out";
+    const auto summary = _eval::runFile(compile("a*b + 1"), path, out, 4096*3*sizeof(_eval::Number)); // 4096-row blocks
+    REQUIRE(summary.count == n);
+    const _eval::ColumnFile results(out);
+    REQUIRE(results.names == std::vector<std::string>{"result"});
+    REQUIRE(results.rows() == n);
+    for (size_t i = 0; i < n; i += 9973) {_eval::Number v; results.read(0, i, 1, &v); REQUIRE(v == a[i]*3 + 1);}
+    REQUIRE_THROWS_AS(_eval::runFile(compile("c"), path, out), const std::invalid_argument &);
+    REQUIRE_THROWS_AS(_eval::runFile(compile("a"), path, "/nonexistent/dir/out"), const std::system_error &);
+    std::remove(out.c_str());
+  }
+
+  SECTION("crashes fail their shard")
+  {
+    _eval::FnMap fns;
+    fns["boom"] = [](_eval::FnArgs args) {if (_eval::Type::toNumber(args[0]) > 150000) std::raise(SIGKILL); return 0;};
+    REQUIRE_THROWS_AS(_eval::runSharded(compile("boom(a)", fns), path, 2), const std::runtime_error &);
+    REQUIRE_THROWS_AS(_eval::runSharded(compile("c"), path, 2), const std::invalid_argument &);
+  }
+
+  SECTION("reaps started shards when it can't start them all")
+  {
+    rlimit saved;
+    getrlimit(RLIMIT_NOFILE, &saved);
+    const auto lowest = dup(0); // Lowest free descriptor, so only a few more can be opened.
+    close(lowest);
+    rlimit low = saved;
+    low.rlim_cur = static_cast<rlim_t>(lowest) + 4;
+    setrlimit(RLIMIT_NOFILE, &low);
+    REQUIRE_THROWS_AS(_eval::runSharded(compile("b"), path, 16), const std::system_error &);
+    setrlimit(RLIMIT_NOFILE, &saved);
+    REQUIRE(waitpid(-1, nullptr, WNOHANG) == -1);
+    REQUIRE(errno == ECHILD);
+  }
+  std::remove(path.c_str());
+}
+
+TEST_CASE("record files")
+{
+#pragma pack(push, 1)
+  struct Tick {int64_t time; float price; uint8_t side; int32_t size; char pad[19];};
+#pragma pack(pop)
+  const std::string path = "/tmp/eval-test-" + std::to_string(getpid()) + ".ticks";
+  std::vector<Tick> ticks(1000);
+  for (size_t i = 0; i < ticks.size(); ++i) ticks[i] = {static_cast<int64_t>(i), 0.5f + static_cast<float>(i), static_cast<uint8_t>(i % 2), -static_cast<int32_t>(i), {}};
+  const auto file = std::fopen(path.c_str(), "wb");
+  std::fwrite("HDR!", 1, 4, file);
+  std::fwrite(ticks.data(), sizeof(Tick), ticks.size(), file);
+  std::fclose(file);
+
+  const auto layout = _eval::RecordLayout(sizeof(Tick))
+    .field("time", 0, _eval::FieldType::I64)
+    .field("price", 8, _eval::FieldType::F32)
+    .field("side", 12, _eval::FieldType::U8)
+    .field("size", 13, _eval::FieldType::I32);
+  const _eval::RecordFile records(path, layout, 4);
+  REQUIRE(records.records() == ticks.size());
+
+  std::vector<_eval::Number> out(records.records());
+  records.run(compile("price*size + side - time"), out.data());
+  for (size_t i = 0; i < ticks.size(); i += 37) {
+    REQUIRE(out[i] == static_cast<_eval::Number>(ticks[i].price)*ticks[i].size + ticks[i].side - static_cast<_eval::Number>(ticks[i].time));
+  }
+  REQUIRE_THROWS_AS(records.run(compile("volume"), out.data()), const std::invalid_argument &);
+  REQUIRE_THROWS_AS(_eval::RecordLayout(0), const std::invalid_argument &);
+  REQUIRE_THROWS_AS(_eval::RecordLayout(sizeof(Tick)).field("size", sizeof(Tick) - 2, _eval::FieldType::I32), const std::invalid_argument &);
+  REQUIRE_THROWS_AS(_eval::RecordLayout(sizeof(Tick)).field("time", std::string::npos, _eval::FieldType::U8), const std::invalid_argument &);
+  std::remove(path.c_str());
+}
+#endif
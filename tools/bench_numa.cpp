@@ -0,0 +1,43 @@
+//
+//  bench_numa.cpp
+//  eval
+//
+//  Batch throughput on a pinned pool with columns placed by the main thread (all on its NUMA node, so
+//  remote for workers on other sockets) against columns first touched by the workers that read them.
+//
+//  usage: bench_numa [rows] [threads]
+//
+
+#include "../eval.h"
+#include <chrono>
+#include <iostream>
+
+using namespace jgod;
+
+namespace {
+  void bench(const char *name, _eval::ThreadPool &pool, const bool local, const size_t n) {
+    const auto p = compile("x*y + sqrt(x) - y/3");
+    _eval::PageBuffer x(n), y(n), out(n);
+    if (local) {
+      _eval::firstTouch(pool, x.data(), n); _eval::firstTouch(pool, y.data(), n); _eval::firstTouch(pool, out.data(), n);
+    }
+    for (size_t i = 0; i < n; ++i) {x.data()[i] = static_cast<_eval::Number>(i % 1000); y.data()[i] = 1.5;}
+    if (!local) std::fill(out.data(), out.data() + n, 0);
+    const _eval::Number *cols[] = {x.data(), y.data()};
+    _eval::runBatch(pool, p, cols, n, out.data()); // Warm up
+
+    const auto runs = 5;
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < runs; ++r) _eval::runBatch(pool, p, cols, n, out.data());
+    const auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << static_cast<double>(n)*runs/secs/1e6 << " M rows/s (checksum " << out.data()[n/2] << ")" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  const size_t rows = argc > 1 ? std::stoul(argv[1]) : 1 << 25;
+  const size_t threads = argc > 2 ? std::stoul(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+  _eval::ThreadPool pool(threads, _eval::Placement::Pinned);
+  bench("main thread's node", pool, false, rows);
+  bench("first touch per worker", pool, true, rows);
+}
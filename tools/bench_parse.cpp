@@ -0,0 +1,47 @@
+//
+//  bench_parse.cpp
+//  eval
+//
+//  Decimal parsing throughput: `_eval::Parse::number()` against `std::stod` and `std::strtod`.
+//
+//  usage: bench_parse [numbers]
+//
+
+#include "../eval.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+
+using namespace jgod;
+
+namespace {
+  template <typename F> void bench(const char *name, const std::string &text, F parse) {
+    const auto start = std::chrono::steady_clock::now();
+    _eval::Number sum = 0;
+    for (auto c = text.data(), end = text.data() + text.size(); c < end;) {
+      const auto nl = static_cast<const char*>(std::memchr(c, '\n', static_cast<size_t>(end - c)));
+      sum += parse(c, nl);
+      c = nl + 1;
+    }
+    const auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << static_cast<double>(text.size())/secs/1e6 << " MB/s (checksum " << sum << ")" << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  const auto count = argc > 1 ? std::stoul(argv[1]) : 5000000;
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> prices(0, 10000);
+  std::uniform_int_distribution<int> decimals(0, 8);
+  std::string text;
+  char buf[64];
+  for (size_t i = 0; i < count; ++i) {
+    std::snprintf(buf, sizeof(buf), "%.*f\n", decimals(rng), prices(rng));
+    text += buf;
+  }
+
+  bench("Parse::number", text, [](const char *c, const char *end) {_eval::Number n = 0; _eval::Parse::number(c, end, n); return n;});
+  bench("std::strtod", text, [](const char *c, const char*) {return std::strtod(c, nullptr);});
+  bench("std::stod", text, [](const char *c, const char *end) {return std::stod(std::string(c, end));});
+}
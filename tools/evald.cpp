@@ -0,0 +1,151 @@
+//
+//  evald.cpp
+//  eval
+//
+//  Keeps a formula library compiled and evaluates pipelined batches sent over a Unix domain socket.
+//
+//  usage: evald <socket path> <library file> [threads]
+//  The library has one formula per line; a formula's ID is its (0-based) line number.
+//
+
+#include "../eval.h"
+#include "evald.h"
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace jgod;
+
+namespace {
+  struct Pending {evald::ResponseHeader header; uint32_t padding; std::vector<_eval::Number> out; std::string text; std::future<void> done;};
+
+  // Reads and drops n bytes, to skip the payload of a request that's being rejected.
+  bool skipAll(const int fd, size_t n) {
+    char buf[64 << 10];
+    for (size_t chunk; n; n -= chunk) {
+      chunk = std::min(n, sizeof(buf));
+      if (!evald::readAll(fd, buf, chunk)) return false;
+    }
+    return true;
+  }
+
+  // Reads requests off a connection and hands them to the pool; a writer thread sends responses back in order.
+  void serve(const int fd, const std::vector<_eval::Program> &library, _eval::ThreadPool &pool) {
+    std::mutex mutex;
+    std::condition_variable cv, room;
+    std::queue<std::shared_ptr<Pending>> inflight;
+    bool closed = false;
+
+    std::thread writer([&]() {
+      for (;;) {
+        std::shared_ptr<Pending> p;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cv.wait(lock, [&]() {return closed || !inflight.empty();});
+          if (inflight.empty()) return;
+          p = inflight.front(); inflight.pop();
+        }
+        room.notify_one();
+        if (p->done.valid()) try {p->done.get();} catch (const std::exception&) {p->header.status = evald::Failed; p->header.size = 0;}
+        auto ok = evald::writeAll(fd, &p->header, sizeof(p->header));
+        if (p->header.status == evald::Ok) ok = ok && (p->text.empty()
+          ? evald::writeAll(fd, p->out.data(), p->out.size()*sizeof(_eval::Number))
+          : evald::writeAll(fd, p->text.data(), p->text.size()));
+        if (!ok) shutdown(fd, SHUT_RDWR);
+      }
+    });
+
+    // Everything about a request is checked before its payload is allocated or read. A payload we can't
+    // skip leaves us out of step with the client, so that connection is answered and closed; so is one
+    // that throws (e.g. bad_alloc), rather than taking the daemon down.
+    try {
+      evald::RequestHeader req;
+      for (auto inStep = true; inStep && evald::readAll(fd, &req, sizeof(req));) {
+        const auto p = std::make_shared<Pending>();
+        p->header = {req.seq, evald::Ok, 0};
+        const auto known = req.expr < library.size();
+        if (req.op == evald::Describe) {
+          if (!known) p->header.status = evald::UnknownExpr;
+          else {
+            for (const auto &v : library[req.expr].vars) p->text += v + "\n";
+            p->header.size = static_cast<uint32_t>(p->text.size());
+          }
+        }
+        else if (req.op != evald::Eval
+                 || static_cast<uint64_t>(req.rows)*std::max(req.cols, 1u) > evald::MAX_PAYLOAD/sizeof(_eval::Number)) {
+          p->header.status = evald::BadInput;
+          inStep = false;
+        }
+        else if (!known || req.cols != library[req.expr].vars.size()) {
+          p->header.status = known ? evald::BadInput : evald::UnknownExpr;
+          inStep = skipAll(fd, static_cast<size_t>(req.rows)*req.cols*sizeof(_eval::Number));
+        }
+        else {
+          const size_t rows = req.rows;
+          auto in = std::make_shared<std::vector<_eval::Number>>(rows*req.cols);
+          if (!evald::readAll(fd, in->data(), in->size()*sizeof(_eval::Number))) break;
+          p->header.size = req.rows;
+          p->out.resize(rows);
+          const auto &program = library[req.expr];
+          p->done = pool.submit([p, in, &program, rows]() {
+            std::vector<const _eval::Number*> cols;
+            for (size_t c = 0; c < program.vars.size(); ++c) cols.push_back(in->data() + c*rows);
+            _eval::runBatch(program, cols.data(), rows, p->out.data());
+          });
+        }
+        {
+          std::unique_lock<std::mutex> lock(mutex); // Backpressure: a client that doesn't read its responses stalls here.
+          room.wait(lock, [&]() {return inflight.size() < evald::MAX_INFLIGHT;});
+          inflight.push(p);
+        }
+        cv.notify_one();
+      }
+    } catch (const std::exception &e) {
+      std::cerr << "evald: dropping a connection: " << e.what() << std::endl;
+    }
+    {std::lock_guard<std::mutex> lock(mutex); closed = true;}
+    cv.notify_one();
+    writer.join();
+    close(fd);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {std::cerr << "usage: evald <socket path> <library file> [threads]" << std::endl; return 1;}
+  std::signal(SIGPIPE, SIG_IGN);
+
+  std::vector<_eval::Program> library;
+  std::ifstream file(argv[2]);
+  for (std::string line; std::getline(file, line);) {
+    try {library.push_back(compile(line));}
+    catch (const std::exception &e) {std::cerr << argv[2] << ":" << library.size() + 1 << ": " << e.what() << std::endl; return 1;}
+  }
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+  if (argc > 3) {
+    char *end;
+    threads = std::strtoul(argv[3], &end, 10);
+    if (*end || !threads) {std::cerr << "evald: threads must be a positive number, not \"" << argv[3] << "\"" << std::endl; return 1;}
+  }
+  _eval::ThreadPool pool(threads);
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  std::string(argv[1]).copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+  const auto server = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(argv[1]);
+  if (server < 0 || bind(server, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(server, 64) < 0) {
+    std::perror("evald"); return 1;
+  }
+  std::set<uint64_t> distinct;
+  for (const auto &p : library) distinct.insert(_eval::structuralHash(_eval::canonical(p)));
+  std::cerr << "evald: serving " << library.size() << " formulas (" << distinct.size() << " distinct) on " << argv[1] << std::endl;
+  for (;;) {
+    const auto fd = accept(server, nullptr, nullptr);
+    if (fd < 0) {if (errno == EINTR) continue; std::perror("evald"); return 1;}
+    std::thread(serve, fd, std::cref(library), std::ref(pool)).detach();
+  }
+}
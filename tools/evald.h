@@ -0,0 +1,55 @@
+//
+//  evald.h
+//  eval
+//
+//  Wire protocol shared by the evaluation daemon and its clients.
+//  Everything is native-endian, since both ends live on the same machine.
+//
+//  Request:  RequestHeader, then (Eval) `cols` columns of `rows` doubles, column-major, in slot order.
+//  Response: ResponseHeader, then (Eval) `size` doubles, or (Describe) `size` bytes of
+//            newline-separated variable names in slot order.
+//
+
+#ifndef jgod_evald_h
+#define jgod_evald_h
+
+#include <cstdint>
+#include <cerrno>
+#include <unistd.h>
+
+namespace jgod { namespace evald {
+  enum Op : uint32_t {Eval = 0, Describe = 1};
+  enum Status : int32_t {Ok = 0, UnknownExpr = 1, BadInput = 2, Failed = 3};
+
+  struct RequestHeader {uint32_t op; uint32_t seq; uint32_t expr; uint32_t rows; uint32_t cols;};
+  struct ResponseHeader {uint32_t seq; int32_t status; uint32_t size;};
+
+  // Largest Eval request the daemon takes, in bytes of input (rows*cols doubles) and of output (rows doubles);
+  // bigger ones get BadInput and the connection is closed.
+  const uint64_t MAX_PAYLOAD = 64 << 20;
+  // Requests the daemon holds per connection; once that many are unanswered it stops reading until one is sent.
+  const size_t MAX_INFLIGHT = 256;
+
+  inline bool readAll(const int fd, void *buf, size_t n) {
+    auto p = static_cast<char*>(buf);
+    while (n) {
+      const auto r = ::read(fd, p, n);
+      if (r < 0 && errno == EINTR) continue;
+      if (r <= 0) return false;
+      p += r; n -= static_cast<size_t>(r);
+    }
+    return true;
+  }
+
+  inline bool writeAll(const int fd, const void *buf, size_t n) {
+    auto p = static_cast<const char*>(buf);
+    while (n) {
+      const auto w = ::write(fd, p, n);
+      if (w < 0 && errno == EINTR) continue;
+      if (w <= 0) return false;
+      p += w; n -= static_cast<size_t>(w);
+    }
+    return true;
+  }
+}}
+#endif /* jgod_evald_h */
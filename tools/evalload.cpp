@@ -0,0 +1,70 @@
+//
+//  evalload.cpp
+//  eval
+//
+//  Load generator for evald: pipelines batches of random inputs at one formula and reports throughput.
+//
+//  usage: evalload <socket path> <formula ID> [requests] [rows per request] [window]
+//
+
+#include "evald.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace jgod;
+
+int main(int argc, char **argv) {
+  if (argc < 3) {std::cerr << "usage: evalload <socket path> <formula ID> [requests] [rows per request] [window]" << std::endl; return 1;}
+  const auto expr = static_cast<uint32_t>(std::stoul(argv[2]));
+  const auto requests = argc > 3 ? std::stoul(argv[3]) : 1000;
+  const auto rows = static_cast<uint32_t>(argc > 4 ? std::stoul(argv[4]) : 4096);
+  const auto window = argc > 5 ? std::stoul(argv[5]) : 16;
+  // This client sends a whole window before reading; past what evald holds, both ends would block writing.
+  if (!window || window > evald::MAX_INFLIGHT) {std::cerr << "evalload: window must be 1 to " << evald::MAX_INFLIGHT << std::endl; return 1;}
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  std::string(argv[1]).copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+  const auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {std::perror("evalload"); return 1;}
+
+  // Ask how many columns the formula takes.
+  evald::RequestHeader req = {evald::Describe, 0, expr, 0, 0};
+  evald::ResponseHeader res;
+  std::string names;
+  if (!evald::writeAll(fd, &req, sizeof(req)) || !evald::readAll(fd, &res, sizeof(res))) {std::cerr << "evalload: connection lost" << std::endl; return 1;}
+  if (res.status != evald::Ok) {std::cerr << "evalload: unknown formula " << expr << std::endl; return 1;}
+  names.resize(res.size);
+  if (!evald::readAll(fd, &names[0], names.size())) return 1;
+  const auto cols = static_cast<uint32_t>(std::count(names.begin(), names.end(), '\n'));
+
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> dist(-100, 100);
+  std::vector<double> in(static_cast<size_t>(rows)*cols), out(rows);
+  for (auto &v : in) v = dist(rng);
+
+  const auto start = std::chrono::steady_clock::now();
+  size_t sent = 0, received = 0;
+  while (received < requests) {
+    for (; sent < requests && sent - received < window; ++sent) { // Keep `window` requests in flight.
+      req = {evald::Eval, static_cast<uint32_t>(sent), expr, rows, cols};
+      if (!evald::writeAll(fd, &req, sizeof(req)) || !evald::writeAll(fd, in.data(), in.size()*sizeof(double))) {std::cerr << "evalload: connection lost" << std::endl; return 1;}
+    }
+    if (!evald::readAll(fd, &res, sizeof(res))) {std::cerr << "evalload: connection lost" << std::endl; return 1;}
+    if (res.status != evald::Ok) {std::cerr << "evalload: request " << res.seq << " failed with " << res.status << std::endl; return 1;}
+    if (!evald::readAll(fd, out.data(), res.size*sizeof(double))) return 1;
+    ++received;
+  }
+  const auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << requests << " requests x " << rows << " rows in " << secs << "s: "
+            << static_cast<double>(requests)/secs << " req/s, " << static_cast<double>(requests*rows)/secs/1e6 << " Mrows/s" << std::endl;
+  close(fd);
+}